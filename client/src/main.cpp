@@ -1,6 +1,9 @@
 #include <iostream>
+#include <limits>
 #include <regex>
 
+#include <cstring>
+
 #include <sys/fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -11,20 +14,40 @@
 #include <network_constants/constants.h>
 #include <support/network.h>
 
+// long responses (like listing of a big directory) come in several parts, a response is read up to RESPONSE_END
+int read_response(int socket_fd, std::string* response_ptr) {
+  response_ptr->clear();
+  do {
+    char buffer[4096];
+    int bytes_received = read(socket_fd, &buffer, sizeof(buffer));
+    if (bytes_received < 0) {
+      perror("Response receiving failed");
+      return -1;
+    }
+
+    if (bytes_received == 0) {
+      return -1;
+    }
+
+    response_ptr->append(buffer, bytes_received);
+  } while (response_ptr->back() != RESPONSE_END);
+
+  response_ptr->pop_back();
+  return 0;
+}
+
 int proxy_command(int socket_fd, const std::string& query) {
   int bytes_sent = writeall(socket_fd, query.c_str(), query.size());
   if (bytes_sent < 0) {
     perror("Query sending failed");
   }
 
-  char buffer[4096];
-  int bytes_received = read(socket_fd, &buffer, sizeof(buffer));
-  if (bytes_received < 0) {
-    perror("Response receiving failed");
+  std::string response;
+  if (read_response(socket_fd, &response) < 0) {
     return -1;
   }
 
-  std::cout << std::string(buffer, bytes_received) << std::endl;
+  std::cout << response << std::endl;
 
   return 0;
 }
@@ -112,13 +135,12 @@ int store(int socket_fd, const std::string& query) {
 
   close(from_fd);
 
-  char buffer[MAX_TRANSMISSION_LEN];
-  int bytes_received = read(socket_fd, buffer, sizeof(buffer));
-  if (bytes_received < 0) {
+  std::string response;
+  if (read_response(socket_fd, &response) < 0) {
     return -1;
   }
 
-  std::cout << std::string(buffer, bytes_received) << std::endl;
+  std::cout << response << std::endl;
   return 0;
 }
 
@@ -231,13 +253,12 @@ int load(int socket_fd, const std::string& query) {
     bytes_written += current_write_len;
   }
 
-  char buffer[MAX_TRANSMISSION_LEN];
-  int bytes_received = read(socket_fd, buffer, sizeof(buffer));
-  if (bytes_received < 0) {
+  std::string response;
+  if (read_response(socket_fd, &response) < 0) {
     return -1;
   }
 
-  std::cout << std::string(buffer, bytes_received) << std::endl;
+  std::cout << response << std::endl;
 
   return 0;
 }
@@ -256,6 +277,8 @@ int main(int argc, char** argv) {
       "\trmfile <filepath>\n\t\tdelete file\n"
       "\tmkdir <dirpath>\n\t\tcreate directory\n"
       "\trmdir <dirpath>\n\t\tdelete directory\n"
+      "\ttruncate <filepath> <size>\n\t\tchange file size, freeing blocks after the new end\n"
+      "\tmv <from_path> <to_path>\n\t\tmove file or directory, a file at to_path is replaced\n"
       "\tstore <from_path> <to_path>\n\t\tstore from outer filesystem to app filesystem\n"
       "\tload <from_path> <to_path>\n\t\tload to outer filesystem from app filesystem";
 
@@ -267,6 +290,8 @@ int main(int argc, char** argv) {
   const std::regex mkdir_cmd_regex(R"(^\s*mkdir\s+)");
   const std::regex rmdir_cmd_regex(R"(^\s*rmdir\s+)");
   const std::regex lsdir_cmd_regex(R"(^\s*lsdir\s+)");
+  const std::regex truncate_cmd_regex(R"(^\s*truncate\s+)");
+  const std::regex mv_cmd_regex(R"(^\s*mv\s+)");
   const std::regex store_cmd_regex(R"(^\s*store\s+)");
   const std::regex load_cmd_regex(R"(^\s*load\s+)");
 
@@ -318,7 +343,8 @@ int main(int argc, char** argv) {
 
     } else if (std::regex_search(input, match, mkfile_cmd_regex) || std::regex_search(input, match, rmfile_cmd_regex) ||
                std::regex_search(input, match, mkdir_cmd_regex) || std::regex_search(input, match, rmdir_cmd_regex) ||
-               std::regex_search(input, match, lsdir_cmd_regex)) {
+               std::regex_search(input, match, lsdir_cmd_regex) ||
+               std::regex_search(input, match, truncate_cmd_regex) || std::regex_search(input, match, mv_cmd_regex)) {
       if (proxy_command(socket_fd, input) < 0) {
         break;
       }
@@ -1,30 +1,159 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "internal/filesystem.h"
 
 namespace fspp {
 
+struct DirEntry {
+  std::string name;
+  bool is_dir{false};
+};
+
+struct FileStat {
+  bool is_dir{false};
+  // size in bytes, size of links for a directory
+  uint64_t size{0};
+  uint64_t inode_id{0};
+  // number of allocated data blocks, holes aren't counted
+  uint64_t blocks_count{0};
+};
+
+/*!
+ * Open file pinned by its inode id, so reads and writes don't resolve the path again.
+ *
+ * Handle is obtained with FileSystemClient::open and is closed on destruction. If the file is deleted while it's
+ * open, the handle keeps working and the file is reclaimed after the handle is closed.
+ */
+class FileHandle {
+ public:
+  FileHandle() = default;
+  ~FileHandle();
+
+  FileHandle(const FileHandle& other) = delete;
+  FileHandle& operator=(const FileHandle& other) = delete;
+  FileHandle(FileHandle&& other) noexcept;
+  FileHandle& operator=(FileHandle&& other) noexcept;
+
+  [[nodiscard]] bool isOpen() const {
+    return fs_ != nullptr;
+  }
+
+  // same as readFileContent/writeFileContent of FileSystemClient
+  int pread(void* buffer, uint64_t size, uint64_t offset);
+  int pwrite(const void* buffer, uint64_t size, uint64_t offset);
+
+  /*!
+   * zero-copy pread: appends ranges of the mapped ffile that hold up to _size_ bytes at _offset_ to _ranges_, so they
+   * can be passed to writev without copying, holes point to a shared zeroed buffer
+   * @note ranges are read-only, they stay valid until unmapRanges or close: if the file is truncated meanwhile, its
+   * content is moved to blocks that aren't given to other files until then (so a truncate of a mapped file copies the
+   * part that is kept). ranges aren't locked, so bytes written concurrently may be seen partially
+   * @return number of bytes covered by the appended ranges
+   */
+  int mapRange(uint64_t offset, uint64_t size, std::vector<iovec>* ranges);
+  /*!
+   * ranges returned by mapRange become invalid, blocks freed from the file while they were held can be reused
+   */
+  void unmapRanges();
+
+  uint64_t size();
+
+  int reserve(uint64_t size);
+  int truncate(uint64_t new_size);
+  int seekData(uint64_t offset, uint64_t* result_ptr);
+  int seekHole(uint64_t offset, uint64_t* result_ptr);
+
+  void close();
+
+ private:
+  friend class FileSystemClient;
+
+  FileHandle(internal::FileSystem* fs, uint64_t inode_id);
+
+  internal::Inode& inode();
+
+ private:
+  internal::FileSystem* fs_{nullptr};
+  uint64_t inode_id_{0};
+  // whether the inode is mapped by this handle, from the first mapRange until unmapRanges
+  bool is_mapped_{false};
+};
+
+/*!
+ * Methods of the client and of open handles may be called from many threads at once, operations on the same file
+ * are serialized by its lock. A handle shouldn't be closed or moved while another thread uses it.
+ */
 class FileSystemClient {
  public:
   explicit FileSystemClient(const std::string& ffile_path);
 
+  /*!
+   * resolves _path_ once and reports everything the commands check separately with exists*, fileSize and so on
+   * @return 0 on success, -1 if there is no such file or directory
+   */
+  int stat(const std::string& path, FileStat* stat_ptr);
+
   bool existsDir(const std::string& dir_path);
   int createDir(const std::string& dir_path);
   int deleteDir(const std::string& dir_path);
   int listDir(const std::string& dir_path, std::string& output);
 
+  /*!
+   * lists directory page by page: pass 0 as cursor for the first page, then the returned cursor until it becomes
+   * DIR_END_CURSOR
+   * @param entries_ptr up to _max_count_ entries are appended here
+   */
+  int readDir(const std::string& dir_path, uint64_t* cursor_ptr, uint64_t max_count,
+              std::vector<DirEntry>* entries_ptr);
+  // rewrites live entries of the directory densely and frees blocks after them
+  int compactDir(const std::string& dir_path);
+
   bool existsFile(const std::string& file_path);
   int createFile(const std::string& file_path);
+  // like createFile, but an existing file is fine unless _fail_if_exists_ is set
+  int createFile(const std::string& file_path, bool fail_if_exists);
   int deleteFile(const std::string& file_path);
 
+  /*!
+   * moves file or directory without copying its data, a file at _to_path_ is replaced
+   * @return 0 on success, -1 if there is no such entry, there is no parent directory of _to_path_ or _to_path_ is
+   * a directory
+   */
+  int rename(const std::string& from_path, const std::string& to_path);
+
+  // deleted files and directories are freed in the background, this waits until their space is available
+  void waitForReclaim();
+
+  /*!
+   * resolves _file_path_ once, later operations on the handle work with the inode directly
+   * @return 0 on success, -1 if there is no such file
+   */
+  int open(const std::string& file_path, FileHandle* handle_ptr);
+  /*!
+   * like open, but creates the file if there is no such one (with missing directories on the way), like O_CREAT
+   * @param created_ptr where to store whether the file was created, may be nullptr
+   */
+  int open(const std::string& file_path, FileHandle* handle_ptr, bool create, bool* created_ptr = nullptr);
+
   // one must use only after successful existsFile
   uint64_t fileSize(const std::string& file_path);
 
   int readFileContent(const std::string& file_path, uint64_t offset, void* buffer, uint64_t size);
   int writeFileContent(const std::string& file_path, uint64_t offset, const void* buffer, uint64_t size);
 
+  // allocates space for _size_ bytes of the file up front, so writes up to _size_ can't run out of space
+  int reserve(const std::string& file_path, uint64_t size);
+
+  // frees blocks after _new_size_, growing the file leaves a hole that reads as zeros
+  int truncate(const std::string& file_path, uint64_t new_size);
+
+  // holes and reserved but unwritten blocks read as zeros and take no data, like SEEK_DATA/SEEK_HOLE of lseek
+  int seekData(const std::string& file_path, uint64_t offset, uint64_t* result_ptr);
+  int seekHole(const std::string& file_path, uint64_t offset, uint64_t* result_ptr);
+
  private:
   internal::FileSystem fs_;
 };
@@ -1,13 +1,25 @@
 #pragma once
 
 #include <cstdint>
+#include <vector>
 
 namespace fspp::internal {
 
+/*!
+ * Bitmap over _element_num_ elements with an in-memory summary index.
+ *
+ * summary level 0 has a bit per 64-bit word of the bitmap that is set when the word is full,
+ * level 1 has a bit per full word of level 0 and so on up to a single word.
+ * Summary is built on construction and kept in sync by setBit/clearBit, so search costs O(log64(element_num)).
+ */
 class BitSet {
  public:
   BitSet();
   explicit BitSet(uint64_t element_num);
+  /*!
+   * @param element_num should be multiple of 64
+   * @param bytes should be 8-byte aligned, bitset doesn't take ownership
+   */
   BitSet(uint64_t element_num, uint8_t* bytes);
   ~BitSet();
 
@@ -19,16 +31,67 @@ class BitSet {
   void setBit(uint64_t index);
   void clearBit(uint64_t index);
   uint8_t getBit(uint64_t index);
+
+  /*!
+   * next-fit search: continues from the position of the last found bit
+   * @note aborts if there is no clean bit
+   */
   uint64_t findCleanBit();
 
+  /*!
+   * @param from index to start search from (search doesn't wrap around)
+   * @param result_ptr where to store index of the first clean bit at or after _from_
+   * @return 0 on success, -1 if there is no clean bit at or after _from_
+   */
+  int findCleanBit(uint64_t from, uint64_t* result_ptr);
+
+  /*!
+   * @param from index to start search from (search doesn't wrap around)
+   * @param len required run length
+   * @param result_ptr where to store index of the first bit of the run
+   * @return 0 on success, -1 if there is no run of _len_ clean bits at or after _from_
+   */
+  int findCleanRun(uint64_t from, uint64_t len, uint64_t* result_ptr);
+
+  /*!
+   * @return length of the run of clean bits that starts at _from_, but no more than _max_len_
+   */
+  uint64_t cleanRunLength(uint64_t from, uint64_t max_len);
+
+  /*!
+   * @return length of the run of set bits that starts at _from_, but no more than _max_len_
+   */
+  uint64_t setRunLength(uint64_t from, uint64_t max_len);
+
+  void setRange(uint64_t from, uint64_t len);
+  void clearRange(uint64_t from, uint64_t len);
+
+  [[nodiscard]] uint64_t size() const {
+    return element_num_;
+  }
+
  private:
-  uint8_t* getByteByIndex(uint64_t index);
-  static uint8_t bitmaskByBitIndex(uint8_t bit_index);
+  void buildSummary();
+  void markWordFull(uint64_t word_index);
+  void markWordNotFull(uint64_t word_index);
+
+  uint64_t* levelWords(int64_t level);
+  uint64_t levelBitNum(int64_t level) const;
+  bool findZeroFrom(int64_t level, uint64_t from, uint64_t* result_ptr);
+
+  /*!
+   * @param invert_mask FULL_WORD to count set bits, 0 to count clean ones
+   */
+  uint64_t runLength(uint64_t from, uint64_t max_len, uint64_t invert_mask);
 
  private:
   bool has_ownership_{false};
   uint64_t element_num_{0};
   uint8_t* bytes_{nullptr};
+
+  // summary_[i] is level i of the summary, the bitmap itself is level -1
+  std::vector<std::vector<uint64_t>> summary_;
+  uint64_t cursor_{0};
 };
 
 }  // namespace fspp::internal
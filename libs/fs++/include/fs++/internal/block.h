@@ -1,7 +1,9 @@
 #pragma once
 
-#include "bitset.h"
+#include <vector>
+
 #include "config.h"
+#include "group.h"
 
 namespace fspp::internal {
 
@@ -11,25 +13,55 @@ struct Block {
 
 static_assert(sizeof(Block) == BLOCK_SIZE);
 
+/*!
+ * run of physically contiguous blocks
+ */
+using BlockRange = IdRange;
+
 class Blocks {
  public:
   Blocks() = default;
-  [[maybe_unused]] Blocks(const uint64_t* block_num_ptr, uint64_t* free_block_num_ptr, uint8_t* bit_set_bytes,
-                          Block* block_bytes);
-  Blocks(void* blocks_ptr_start, uint64_t* free_block_num_ptr, BitSet blocks_bitset);
+  Blocks(void* blocks_ptr_start, AllocationGroups block_groups);
 
   Block& getBlockById(uint64_t block_id);
 
-  int createBlock(id_t* created_id);
+  /*!
+   * @param hint block is allocated as close after _hint_ as possible
+   */
+  int createBlock(id_t hint, id_t* created_id);
+
+  /*!
+   * allocates _count_ blocks as few contiguous runs as possible
+   *
+   * prefers the first run after _hint_ that fits all blocks, otherwise takes free runs in order starting at _hint_
+   * @param count number of blocks to allocate
+   * @param hint block id to start search from
+   * @param created_ranges allocated runs are appended here
+   * @return 0 on success, -1 if there are not enough free blocks (nothing is allocated then)
+   */
+  int createBlocks(uint64_t count, id_t hint, std::vector<BlockRange>* created_ranges);
   int deleteBlock(id_t block_id);
+  int deleteBlocks(const BlockRange& range);
 
   uint64_t getFreeBlockNum();
+  bool isAllocated(id_t block_id);
+
+  [[nodiscard]] uint64_t blockCount() const {
+    return groups_.groupNum() * groups_.groupSize();
+  }
+
+  [[nodiscard]] uint64_t groupNum() const {
+    return groups_.groupNum();
+  }
+
+  [[nodiscard]] id_t groupStart(uint64_t group) const {
+    return groups_.groupStart(group);
+  }
 
  private:
   Block* blocks_ptr_{nullptr};
 
-  uint64_t* free_block_num_ptr_{nullptr};
-  BitSet bit_set_{};
+  AllocationGroups groups_{};
 };
 
-}  // namespace fspp::internal
\ No newline at end of file
+}  // namespace fspp::internal
@@ -1,33 +1,59 @@
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 
-#define NORMAL_ILIST
-
 namespace fspp {
 
 typedef uint64_t id_t;
 
-// should be multiple of 8
+// should be multiple of 64
 const uint64_t DEFAULT_BLOCK_COUNT = 64 * 1024 * 64;
 const uint64_t DEFAULT_INODE_COUNT = 64 * 16;
+// both blocks and inodes are split into this number of allocation groups
+const uint64_t DEFAULT_GROUP_COUNT = 16;
 const uint64_t BLOCK_SIZE = 4096 * 2;
 const uint64_t MAX_LINK_NAME_LEN = 62;
-const uint64_t ILIST_ZERO_INDIRECTION = 10;
 const uint64_t IDS_IN_BLOCK_COUNT = BLOCK_SIZE / sizeof(uint64_t);
-
-#ifdef NORMAL_ILIST
-const uint64_t INODE_MAX_BLOCK_COUNT =
-    ILIST_ZERO_INDIRECTION + IDS_IN_BLOCK_COUNT + IDS_IN_BLOCK_COUNT * IDS_IN_BLOCK_COUNT;
-#else
-const uint64_t INODE_MAX_BLOCK_COUNT = 512;
-#endif
+const uint64_t ILIST_ROOT_EXTENT_COUNT = 8;
+// small files share blocks split into fragments
+const uint64_t FRAGMENT_SIZE = 512;
+const uint64_t FRAGMENTS_IN_BLOCK_COUNT = BLOCK_SIZE / FRAGMENT_SIZE;
+// directories with this number of links get a hash index
+const uint64_t DIR_INDEX_MIN_LINK_COUNT = 512;
+const uint64_t DIR_INDEX_SLOTS_IN_BLOCK_COUNT = BLOCK_SIZE / sizeof(uint64_t);
+// directories with this number of links are compacted when more than half of links are dead
+const uint64_t DIR_COMPACTION_MIN_LINK_COUNT = 64;
+// number of (parent, name) entries kept by the in-memory dentry cache
+const uint64_t DENTRY_CACHE_CAPACITY = 4096;
+const uint64_t DENTRY_CACHE_SHARD_COUNT = 16;
+// deleted files are freed in the background in steps of this number of blocks or links
+const uint64_t RECLAIM_BATCH_BLOCK_COUNT = 1024;
+const uint64_t RECLAIM_BATCH_LINK_COUNT = 128;
+// orphans that are locked by someone are retried after this interval
+const std::chrono::milliseconds RECLAIM_RETRY_INTERVAL{10};
+// holes are mapped to a shared zeroed buffer of this size, longer holes take several ranges
+const uint64_t ZERO_RANGE_SIZE = 16 * BLOCK_SIZE;
+// lookups and reads without locks are retried this many times when they race with writers, then they take locks and
+// wait for the writers
+const uint64_t OPTIMISTIC_READ_ATTEMPTS = 4;
+// directory listing cursor that has no more entries
+const uint64_t DIR_END_CURSOR = UINT64_MAX;
+// extent is 24 bytes, node starts with extent count
+const uint64_t EXTENTS_IN_BLOCK_COUNT = (BLOCK_SIZE - sizeof(uint64_t)) / 24;
+
+// file size in bytes should fit in uint64_t
+const uint64_t INODE_MAX_BLOCK_COUNT = UINT64_MAX / BLOCK_SIZE;
 
 static_assert(sizeof(char) == sizeof(uint8_t), "char should be 1 byte");
-static_assert(DEFAULT_BLOCK_COUNT % 8 == 0);   // current requirement of bitset
-static_assert(DEFAULT_INODE_COUNT % 8 == 0);   // current requirement of bitset
+static_assert(DEFAULT_BLOCK_COUNT % 64 == 0);  // current requirement of bitset
+static_assert(DEFAULT_INODE_COUNT % 64 == 0);  // current requirement of bitset
 static_assert(DEFAULT_BLOCK_COUNT % 64 == 0);  // requirement of layout
 static_assert(DEFAULT_INODE_COUNT % 64 == 0);  // requirement of layout
 static_assert(BLOCK_SIZE % sizeof(id_t) == 0);
+static_assert(BLOCK_SIZE % FRAGMENT_SIZE == 0);
+static_assert(FRAGMENTS_IN_BLOCK_COUNT <= 64);  // fragment bitmap of a block is a single word
+static_assert(DEFAULT_BLOCK_COUNT % (DEFAULT_GROUP_COUNT * 64) == 0);  // requirement of allocation groups
+static_assert(DEFAULT_INODE_COUNT % (DEFAULT_GROUP_COUNT * 64) == 0);  // requirement of allocation groups
 
 }  // namespace fspp
\ No newline at end of file
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "config.h"
+
+namespace fspp::internal {
+
+/*!
+ * Bounded LRU cache of directory entries keyed on (parent inode, name).
+ *
+ * Negative entries remember names that are known to be absent, so repeated lookups of missing paths don't scan
+ * directories either. The cache is kept only in memory and must be invalidated by every operation that adds or
+ * removes links.
+ *
+ * Entries are spread over DENTRY_CACHE_SHARD_COUNT shards with their own locks and LRU lists, so concurrent path walks
+ * don't contend on a single lock.
+ */
+class DentryCache {
+ public:
+  enum class LookupResult {
+    MISS,
+    FOUND,
+    NOT_FOUND,
+  };
+
+  explicit DentryCache(uint64_t capacity = DENTRY_CACHE_CAPACITY);
+
+  DentryCache(const DentryCache& other) = delete;
+  DentryCache& operator=(const DentryCache& other) = delete;
+
+  /*!
+   * @param child_id_ptr where to store id of the child if it's found
+   */
+  LookupResult lookup(uint64_t parent_id, std::string_view name, uint64_t* child_id_ptr);
+
+  void insert(uint64_t parent_id, std::string_view name, uint64_t child_id);
+  void insertNegative(uint64_t parent_id, std::string_view name);
+
+  /*!
+   * inserts entry found without the lock of the parent only if _parent_version_ still equals _version_ (see
+   * Inodes::getVersion), writers invalidate entries while the version is changed, so a stale entry isn't inserted
+   */
+  void insert(uint64_t parent_id, std::string_view name, uint64_t child_id,
+              const std::atomic<uint64_t>& parent_version, uint64_t version);
+  void insertNegative(uint64_t parent_id, std::string_view name, const std::atomic<uint64_t>& parent_version,
+                      uint64_t version);
+
+  void invalidate(uint64_t parent_id, std::string_view name);
+
+  /*!
+   * forgets all entries of the directory, used when its inode id is reused: walks that entered the deleted directory
+   * before it was unlinked may have cached its entries after that
+   */
+  void forgetDirectory(uint64_t parent_id);
+
+ private:
+  static const uint64_t NEGATIVE_ENTRY = UINT64_MAX;
+
+  struct Key {
+    uint64_t parent_id;
+    std::string name;
+  };
+
+  // lookups by view don't allocate a string
+  struct KeyView {
+    uint64_t parent_id;
+    std::string_view name;
+  };
+
+  struct KeyHash {
+    using is_transparent = void;
+
+    size_t operator()(const KeyView& key) const {
+      return std::hash<std::string_view>()(key.name) ^ (key.parent_id * 0x9E3779B97F4A7C15);
+    }
+
+    size_t operator()(const Key& key) const {
+      return (*this)(KeyView{key.parent_id, key.name});
+    }
+  };
+
+  struct KeyEqual {
+    using is_transparent = void;
+
+    template <class Left, class Right>
+    bool operator()(const Left& left, const Right& right) const {
+      return left.parent_id == right.parent_id && std::string_view(left.name) == std::string_view(right.name);
+    }
+  };
+
+  struct Entry {
+    Key key;
+    uint64_t child_id;
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    // most recently used entries are at the front
+    std::list<Entry> lru;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash, KeyEqual> entries;
+  };
+
+  Shard& getShard(const KeyView& key);
+  void put(uint64_t parent_id, std::string_view name, uint64_t child_id,
+           const std::atomic<uint64_t>* parent_version = nullptr, uint64_t version = 0);
+
+ private:
+  uint64_t shard_capacity_;
+  Shard shards_[DENTRY_CACHE_SHARD_COUNT];
+};
+
+}  // namespace fspp::internal
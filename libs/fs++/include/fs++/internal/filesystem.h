@@ -1,39 +1,220 @@
 #pragma once
 
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "block.h"
+#include "dcache.h"
+#include "fragment.h"
 #include "inode.h"
+#include "reclaimer.h"
 #include "superblock.h"
 
 namespace fspp::internal {
 
+/*!
+ * FileSystem may be used from many threads at once.
+ *
+ * Every inode has a reader/writer lock (see Inodes). Locks are taken in this order:
+ * rename lock, then inode locks from parent to child (path walks hold a directory until its child is locked),
+ * then internal locks of the reclaimer, dentry cache and allocators. Operations that take Inode* expect the caller
+ * to hold lock of that inode: shared one for read, mapRange and seeks, exclusive one for changes.
+ *
+ * Content of a mapped inode (see mapInode) isn't freed in place: it's moved to a holder orphan that is reclaimed after
+ * the inode is unmapped, so ranges returned by mapRange stay readable after the lock is released. Other inodes free
+ * their blocks at once.
+ *
+ * Lookups, stats, listings and reads by path take no locks at first: they walk the tree checking versions of the
+ * inodes (see Inodes) and start over if some of them changed meanwhile. After OPTIMISTIC_READ_ATTEMPTS such races
+ * they fall back to locks, so a busy directory doesn't starve them.
+ */
 class FileSystem {
  public:
   explicit FileSystem(const std::string& ffile_path);
   ~FileSystem();
 
-  int createFDE(const std::string& fde_path, bool is_dir);
-  int getFDEInodeId(std::string fde_path, uint64_t* result_ptr);
+  /*!
+   * creates the entry and missing directories on the way to it
+   * @param fail_if_exists whether existing entry of the same type is an error, otherwise it's reused
+   * @param inode_id_ptr where to store id of the created or reused entry, may be nullptr
+   * @param lock_ptr where to store shared lock of the entry, may be nullptr
+   * @param created_ptr where to store whether the entry was created rather than reused, may be nullptr
+   * @return 0 on success, -1 if the entry can't be created or exists (of another type or _fail_if_exists_ is set)
+   */
+  int createFDE(const std::string& fde_path, bool is_dir, bool fail_if_exists, uint64_t* inode_id_ptr,
+                InodeLock* lock_ptr = nullptr, bool* created_ptr = nullptr);
+  /*!
+   * resolves the entry and locks it, so it can't be unlinked and reclaimed until the lock is released
+   */
+  int lookupFDE(const std::string& fde_path, bool lock_exclusively, uint64_t* inode_id_ptr, InodeLock* lock_ptr);
+  /*!
+   * resolves the entry and reads its stat without locking it, so it never waits for writes to the entry
+   * @param inode_id_ptr where to store id of the entry, it may be unlinked and reused right after the call
+   */
+  int statFDE(const std::string& fde_path, uint64_t* inode_id_ptr, InodeStat* stat_ptr);
   bool existsFDE(const std::string& fde_path);
+  /*!
+   * reads content of the entry like read, without locks if it doesn't race with writers
+   * @note content is overwritten in place, so a read that races with a write to the entry can't be served from an
+   * older version: after OPTIMISTIC_READ_ATTEMPTS it takes the shared lock and waits for the write to finish
+   */
+  int readFDE(const std::string& fde_path, void* buffer, uint64_t offset, uint64_t count);
+  /*!
+   * unlinks the entry at once, its blocks are freed in the background
+   */
   int deleteFDE(const std::string& fde_path, bool is_dir);
+  /*!
+   * moves the entry by relinking it, data blocks aren't touched
+   *
+   * an existing file at _to_path_ is replaced by a file and reclaimed like deleted one, a directory there is never
+   * replaced. the move is recorded in the superblock before the new link is written, so after a crash it's either
+   * finished on mount or not done at all
+   * @return 0 on success, -1 if there is no such entry, _to_path_ is inside of the moved directory or can't be replaced
+   */
+  int renameFDE(const std::string& from_path, const std::string& to_path);
+  int compactDir(const std::string& dir_path);
 
   Inode& getInodeById(uint64_t inode_id);
+  InodeLock lockInode(uint64_t inode_id, bool lock_exclusively);
+  /*!
+   * @note the inode should be kept from reclaim by the caller (e.g. it's open)
+   */
+  InodeStat statInode(uint64_t inode_id) const;
 
-  int createChild(Inode& parent_inode, const std::string& name, bool is_dir);
-  int getChildId(Inode& parent_inode, const std::string& name, uint64_t* result_ptr);
-  bool existsChild(Inode& parent_inode, const std::string& name);
+  /*!
+   * open inode isn't reclaimed after it's deleted until it's closed
+   * @note lock of the inode should be held, so it isn't reclaimed before it's pinned
+   */
+  void openInode(uint64_t inode_id);
+  void closeInode(uint64_t inode_id);
+
+  /*!
+   * blocks until blocks of all deleted inodes that aren't open are freed
+   */
+  void waitForReclaim();
+
+  /*!
+   * blocks and fragments of a mapped inode aren't reused until it's unmapped, even if the file is truncated
+   * @note lock of the inode should be held, so truncates see the mapping before they free anything
+   */
+  void mapInode(uint64_t inode_id);
+  // lock of the inode isn't needed, holders of its freed content are reclaimed after the last unmap
+  void unmapInode(uint64_t inode_id);
 
   int read(Inode* inode_ptr, void* buffer, uint64_t offset, uint64_t count) const;
+  int mapRange(Inode* inode_ptr, uint64_t offset, uint64_t count, std::vector<iovec>* ranges) const;
   int write(Inode* inode_ptr, const void* buffer, uint64_t offset, uint64_t count);
   [[maybe_unused]] int append(Inode* inode_ptr, const void* buffer, uint64_t count);
+  int reserve(Inode* inode_ptr, uint64_t size);
+  int truncate(Inode* inode_ptr, uint64_t new_size);
+  int seekData(Inode* inode_ptr, uint64_t offset, uint64_t* result_ptr);
+  int seekHole(Inode* inode_ptr, uint64_t offset, uint64_t* result_ptr);
 
   // maybe need to change interface
   int listDir(const std::string& dir_path, std::string& output);
 
+  /*!
+   * reads up to _max_count_ alive links of the directory starting from _cursor_ptr_
+   * @param cursor_ptr 0 to start listing, updated to the cursor of the next page, DIR_END_CURSOR after the last one
+   * @param links_ptr read links are appended here
+   * @note compaction of the directory between pages may skip or repeat entries
+   * @note like readFDE, a page that races with changes of the directory is read under its shared lock at last, so it
+   * waits for the change to finish
+   */
+  int readDir(const std::string& dir_path, uint64_t* cursor_ptr, uint64_t max_count, std::vector<Link>* links_ptr);
+
  private:
-  int getFDEInodeParentId(std::string fde_path, uint64_t* result_ptr);
-  int deleteInode(uint64_t inode_id);
+  enum class WalkResult {
+    FOUND,
+    NOT_FOUND,
+    // some inode on the way changed while it was read, the walk should be repeated
+    RACED,
+  };
+
+  /*!
+   * resolves _fde_path_ without locks, directories on the way are read from their copies
+   *
+   * link from the parent to the entry is valid while version of the parent equals _parent_version_ptr_, so the
+   * entry can't be reclaimed until the version changes
+   * @param parent_id_ptr where to store id of the parent, root is its own parent
+   * @param parent_version_ptr where to store version of the parent the link was found at
+   * @param inode_id_ptr where to store id of the entry
+   */
+  WalkResult walkOptimistically(std::string_view fde_path, uint64_t* parent_id_ptr, uint64_t* parent_version_ptr,
+                                uint64_t* inode_id_ptr);
+
+  /*!
+   * resolves _fde_path_ like walkOptimistically and copies the entry
+   * @param version_ptr where to store version of the entry, reads from the copy are valid while it's current
+   */
+  WalkResult copyOptimistically(std::string_view fde_path, uint64_t* inode_id_ptr, Inode* inode_copy_ptr,
+                                uint64_t* version_ptr);
+
+  /*!
+   * looks _name_ up in the dentry cache, the copy of the parent is looked up on a miss
+   */
+  WalkResult lookupChildOptimistically(uint64_t parent_id, uint64_t parent_version, std::string_view name,
+                                       uint64_t* child_id_ptr);
+
+  /*!
+   * resolves all components of _fde_path_ but the last one, each directory on the way is looked up once
+   *
+   * directories on the way are locked shared hand over hand, the parent is returned locked
+   * @param create_parents whether missing directories on the way are created
+   * @param lock_exclusively whether the parent is locked exclusively
+   * @param parent_id_ptr where to store id of the directory that should contain the last component
+   * @param name_ptr where to store the last component, it points into _fde_path_ and is empty for root
+   * @param parent_lock_ptr where to store lock of the parent (root for root itself)
+   * @return 0 on success, -1 if the path is malformed or some component on the way isn't a directory
+   */
+  int walkToParent(std::string_view fde_path, bool create_parents, bool lock_exclusively, uint64_t* parent_id_ptr,
+                   std::string_view* name_ptr, InodeLock* parent_lock_ptr);
+
+  /*!
+   * looks _name_ up and creates it as a directory if it's missing
+   * @param parent_lock_ptr lock of the parent, shared one is replaced with exclusive one when directory is created
+   */
+  int lookupOrCreateDir(uint64_t parent_id, std::string_view name, InodeLock* parent_lock_ptr, uint64_t* child_id_ptr);
+
+  /*!
+   * looks _name_ up in the dentry cache, the directory is looked up on a miss
+   */
+  int lookupChild(Inode& parent_inode, std::string_view name, uint64_t* child_id_ptr);
+
+  /*!
+   * @note doesn't check possible existence of the entry
+   */
+  int createChild(Inode& parent_inode, std::string_view name, bool is_dir, uint64_t* child_id_ptr);
+
+  /*!
+   * locks both parents and moves the link, parents should be pinned by the caller
+   */
+  int moveLink(const std::string& from_path, uint64_t from_parent_id, std::string_view from_name,
+               const std::string& to_path, uint64_t to_parent_id, std::string_view to_name);
+
+  /*!
+   * removes the link recorded in the superblock and orphans its inode if the previous mount crashed before it did
+   * @note orphan of the record should be pinned, so the reclaimer doesn't free it before its link is removed
+   */
+  void finishPendingUnlink();
+
+  /*!
+   * if the inode is mapped, moves its content to a new holder orphan that is reclaimed after the inode is unmapped and
+   * copies first _keep_size_ bytes back, so blocks that are about to be freed stay readable through mapped ranges
+   * @note it's called before changes that free content (see Inodes::truncateFreesData), inode is locked exclusively
+   * @return 0 on success, -1 if there is no space for the holder or the copy (the inode isn't changed then)
+   */
+  int moveMappedData(Inode* inode_ptr, uint64_t keep_size);
+
+  /*!
+   * reads a page of links like readDir
+   * @param is_copy whether _inode_ptr_ is a copy of the directory (see Inodes::copyInode) rather than a locked one
+   * @return 0 on success, -1 if links of the copy are inconsistent
+   */
+  int readLinks(Inode* inode_ptr, bool is_copy, uint64_t* cursor_ptr, uint64_t max_count,
+                std::vector<Link>* links_ptr) const;
 
  private:
   int fd_{-1};
@@ -41,6 +222,14 @@ class FileSystem {
   internal::SuperBlock* super_block_ptr_;
   internal::Inodes inodes_;
   internal::Blocks blocks_;
+  internal::Fragments fragments_;
+  internal::DentryCache dentry_cache_;
+  internal::Reclaimer reclaimer_;
+
+  // renames are serialized, so the tree isn't rearranged while both parents of a rename are resolved and locked
+  std::mutex rename_mutex_;
+  // superblock records one pending unlink at a time, it's taken after inode locks and before the reclaimer
+  std::mutex unlink_mutex_;
 };
 
 }  // namespace fspp::internal
\ No newline at end of file
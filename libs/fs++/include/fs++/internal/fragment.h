@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+
+#include "bitset.h"
+#include "block.h"
+
+namespace fspp::internal {
+
+/*!
+ * run of contiguous fragments inside one block
+ */
+struct FragmentRun {
+  id_t block_id{0};
+  uint32_t first{0};
+  uint32_t count{0};
+};
+
+/*!
+ * Packs contents of small files into shared blocks split into FRAGMENT_SIZE fragments.
+ *
+ * Fragment bitmaps are kept in memory only: blocks with fragments are allocated in Blocks as usual, and bitmaps are
+ * rebuilt from inodes on mount with markAllocated. Which blocks are split is stored in the ffile, so a block whose
+ * fragments weren't recorded in any inode before a crash is found by freeEmptyBlocks.
+ */
+class Fragments {
+ public:
+  Fragments() = default;
+  /*!
+   * @param fragment_blocks bit per block of _blocks_, set while the block is split into fragments
+   */
+  Fragments(Blocks* blocks, BitSet fragment_blocks);
+
+  Fragments(const Fragments& other) = delete;
+  Fragments& operator=(const Fragments& other) = delete;
+  Fragments(Fragments&& other) noexcept;
+  Fragments& operator=(Fragments&& other) noexcept;
+
+  /*!
+   * allocates _count_ contiguous fragments, the fullest shared block that fits them is used first
+   * @param hint new block is allocated as close after _hint_ as possible
+   * @return 0 on success, -1 if there are no free blocks
+   */
+  int allocate(uint64_t count, id_t hint, FragmentRun* run_ptr);
+
+  /*!
+   * block is returned to Blocks when its last fragment is freed
+   */
+  void free(const FragmentRun& run);
+
+  void markAllocated(const FragmentRun& run);
+
+  /*!
+   * frees split blocks that have no fragments after all of them were marked with markAllocated
+   * @note should be called on mount before fragments are allocated
+   */
+  void freeEmptyBlocks();
+
+  uint8_t* getBytes(const FragmentRun& run);
+
+ private:
+  static uint64_t runMask(const FragmentRun& run);
+  static uint64_t longestCleanRun(uint64_t bitmap);
+
+  /*!
+   * keeps _blocks_by_free_run_ in sync with the bitmap, block without fragments is forgotten
+   */
+  void setBitmap(id_t block_id, uint64_t old_bitmap, uint64_t new_bitmap);
+
+ private:
+  Blocks* blocks_{nullptr};
+  BitSet fragment_blocks_;
+
+  std::mutex mutex_;
+  // fragment bitmap of each block that has fragments
+  std::unordered_map<id_t, uint64_t> bitmaps_;
+  // blocks by the length of their longest run of free fragments, full blocks aren't stored
+  std::set<id_t> blocks_by_free_run_[FRAGMENTS_IN_BLOCK_COUNT];
+};
+
+}  // namespace fspp::internal
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "bitset.h"
+
+namespace fspp::internal {
+
+/*!
+ * run of contiguous ids
+ */
+struct IdRange {
+  uint64_t start{0};
+  uint64_t length{0};
+};
+
+/*!
+ * Splits id space into groups of equal size. Each group has its own slice of the bitmap, free counter and lock,
+ * so allocations in different groups don't contend.
+ */
+class AllocationGroups {
+ public:
+  AllocationGroups() = default;
+
+  /*!
+   * @param element_num number of ids in all groups
+   * @param group_num number of groups, element_num / group_num should be multiple of 64
+   * @param bitset_bytes bitmap of all ids, each group works with its own slice
+   * @param free_num_ptr total free counter
+   * @param group_free_nums array of _group_num_ free counters
+   */
+  AllocationGroups(uint64_t element_num, uint64_t group_num, uint8_t* bitset_bytes, uint64_t* free_num_ptr,
+                   uint64_t* group_free_nums);
+
+  /*!
+   * allocates single id, starting from the group of _hint_
+   * @return 0 on success, -1 if there are no free ids
+   */
+  int allocate(uint64_t hint, uint64_t* result_ptr);
+
+  /*!
+   * allocates _count_ ids as few contiguous runs as possible
+   *
+   * prefers the first run after _hint_ that fits all ids, otherwise takes free runs in order starting at _hint_
+   * @param created_ranges allocated runs are appended here
+   * @return 0 on success, -1 if there are not enough free ids (nothing is allocated then)
+   */
+  int allocateRange(uint64_t count, uint64_t hint, std::vector<IdRange>* created_ranges);
+
+  /*!
+   * @return 0 on success, -1 if _id_ isn't allocated
+   */
+  int free(uint64_t id);
+
+  /*!
+   * frees run of ids with word-wide bitmap operations, total counter is updated once
+   * @return 0 on success, -1 if some id of the run isn't allocated (ids of groups before it are freed then)
+   */
+  int freeRange(const IdRange& range);
+
+  bool isAllocated(uint64_t id);
+
+  [[nodiscard]] uint64_t getFreeNum() const;
+
+  [[nodiscard]] uint64_t groupNum() const {
+    return groups_.size();
+  }
+
+  [[nodiscard]] uint64_t groupSize() const {
+    return group_size_;
+  }
+
+  [[nodiscard]] uint64_t groupOf(uint64_t id) const {
+    return id / group_size_;
+  }
+
+  [[nodiscard]] uint64_t groupStart(uint64_t group) const {
+    return group * group_size_;
+  }
+
+  /*!
+   * @return group with the most free ids
+   */
+  uint64_t findEmptiestGroup();
+
+ private:
+  struct Group {
+    Group(uint64_t element_num, uint8_t* bitset_bytes, uint64_t* free_num_ptr)
+        : bit_set(element_num, bitset_bytes), free_num_ptr(free_num_ptr) {
+    }
+
+    BitSet bit_set;
+    uint64_t* free_num_ptr;
+    std::mutex mutex;
+  };
+
+  /*!
+   * takes _count_ from the total counter, so later allocation from groups can't run out of ids
+   */
+  bool reserve(uint64_t count);
+
+ private:
+  uint64_t group_size_{0};
+  uint64_t* free_num_ptr_{nullptr};
+  std::deque<Group> groups_;
+};
+
+}  // namespace fspp::internal
@@ -2,26 +2,89 @@
 
 #include <cassert>
 #include <cstdint>
+#include <vector>
 
 #include "block.h"
 #include "compiler.h"
 
 namespace fspp::internal {
 
+// blocks of the extent are allocated, but were never written, so they read as zeros
+const uint32_t EXTENT_UNWRITTEN = 0x1;
+
+// never stored in the tree, reported by getRunByIndex for blocks that aren't mapped, such blocks read as zeros
+const uint32_t EXTENT_HOLE = 0x2;
+
+const uint64_t MAX_EXTENT_LENGTH = UINT32_MAX;
+
+// root and ILIST_MAX_DEPTH levels of nodes map more blocks than a file may have
+const uint64_t ILIST_MAX_DEPTH = 8;
+
+static_assert(DEFAULT_BLOCK_COUNT <= MAX_EXTENT_LENGTH, "any range of blocks should fit in one extent");
+
+/*!
+ * leaf record: _length_ blocks of the file starting from _logical_start_ are stored in blocks starting from
+ * _physical_start_
+ *
+ * index record: blocks of the file starting from _logical_start_ are described by the node stored in block
+ * _physical_start_, _length_ and _flags_ are unused
+ */
+struct Extent {
+  uint64_t logical_start{0};
+  id_t physical_start{0};
+  uint32_t length{0};
+  uint32_t flags{0};
+};
+
+static_assert(sizeof(Extent) == 24);
+
+/*!
+ * extent tree node stored in a block
+ */
+struct ExtentBlock {
+  uint64_t count;
+  Extent records[EXTENTS_IN_BLOCK_COUNT];
+};
+
+static_assert(sizeof(ExtentBlock) <= BLOCK_SIZE);
+
+/*!
+ * Maps file blocks to filesystem blocks with extents.
+ *
+ * Blocks that aren't covered by any extent form holes and read as zeros.
+ *
+ * Up to ILIST_ROOT_EXTENT_COUNT extents are stored right in the inode. When there are more of them, root records
+ * become index records of a B+ tree whose nodes are stored in blocks.
+ */
 class InodesList {
  public:
+  static ExtentBlock& getNode(Blocks* blocks, id_t block_id) {
+    return *reinterpret_cast<ExtentBlock*>(blocks->getBlockById(block_id).bytes);
+  }
+
+  id_t getBlockIdByIndex(Blocks* blocks, uint64_t index);
+
   /*!
    * @param blocks blocks of filesystem
-   * @param block_id id of the block that contains ids of other blocks
-   * @param index index of id in the block
-   * @return block id from block
+   * @param index index of block in file
+   * @param run_length_ptr where to store number of physically contiguous blocks starting from _index_ (number of
+   * unmapped blocks for a hole)
+   * @param flags_ptr where to store flags of the run, EXTENT_HOLE if _index_ isn't mapped
+   * @return id of the block with _index_, 0 for a hole
    */
-  static id_t& resolveIndirection(Blocks* blocks, uint64_t block_id, uint64_t index) {
-    return ((uint64_t*)blocks->getBlockById(block_id).bytes)[index];
-  }
+  id_t getRunByIndex(Blocks* blocks, uint64_t index, uint64_t* run_length_ptr, uint32_t* flags_ptr);
 
-  id_t getBlockIdByIndex(Blocks* blocks, uint64_t index);
+  /*!
+   * like getRunByIndex, but the list is a copy taken without the lock and its nodes may be changed concurrently, so
+   * everything read from them is checked before it's followed
+   * @return 0 on success, -1 if the tree is inconsistent
+   */
+  int getRunByIndexUnlocked(Blocks* blocks, uint64_t index, id_t* block_id_ptr, uint64_t* run_length_ptr,
+                            uint32_t* flags_ptr) const;
 
+  /*!
+   * @return index of the block after the last mapped one
+   */
   [[nodiscard]] uint64_t size() const {
     return size_;
   }
@@ -32,21 +95,119 @@ class InodesList {
 
   void clear() {
     size_ = 0;
+    depth_ = 0;
+    root_count_ = 0;
   }
 
+  /*!
+   * frees all mapped blocks and tree nodes in one walk over the tree, the list becomes empty
+   * @return 0 on success, -1 if some block wasn't allocated
+   */
+  int freeBlocks(Blocks* blocks);
+
+  /*!
+   * unmaps all blocks starting from _index_, frees them and tree nodes that become empty
+   * @param freed_num_ptr where to store number of freed data blocks
+   * @return 0 on success, -1 if some block wasn't allocated
+   */
+  int truncate(Blocks* blocks, uint64_t index, uint64_t* freed_num_ptr);
+
   int addBlock(Blocks* blocks, id_t block_id);
 
+  /*!
+   * maps _range_ to file blocks starting from _index_
+   * @param index first block of the range in file, blocks up to _index_ + _range.length_ should be unmapped
+   * @param unwritten whether blocks should read as zeros until they are written
+   * @param free_nodes new tree nodes are taken from here if it's set (see allocateNodes), otherwise they are allocated
+   * @note on failure the list isn't changed
+   */
+  int addRange(Blocks* blocks, uint64_t index, const BlockRange& range, bool unwritten,
+               std::vector<id_t>* free_nodes = nullptr);
+
+  /*!
+   * marks _count_ blocks starting from _index_ as written
+   * @note blocks should belong to the same unwritten run (see getRunByIndex), on failure the list isn't changed
+   */
+  int markWritten(Blocks* blocks, uint64_t index, uint64_t count);
+
+  /*!
+   * @return upper bound of tree nodes that adding _extent_count_ extents may need: each insert splits at most one node
+   * per level and may add a level
+   */
+  [[nodiscard]] uint64_t maxNodesToInsert(uint64_t extent_count) const;
+
+  /*!
+   * allocates _count_ blocks for tree nodes, they are appended to _free_nodes_ in the order inserts take them
+   */
+  static int allocateNodes(Blocks* blocks, uint64_t count, id_t hint, std::vector<id_t>* free_nodes);
+  // frees nodes that were allocated, but weren't needed
+  static void freeNodes(Blocks* blocks, const std::vector<id_t>& free_nodes);
+
   [[maybe_unused]] uint64_t BlocksNeededToAddBlocks(uint64_t additional_blocks_count) {
     FSC_USED_BY_ASSERT(additional_blocks_count);
     return 0;
   }
 
+ private:
+  static uint64_t findChild(const Extent* records, uint64_t count, uint64_t logical_index);
+  static bool canMerge(const Extent& left, const Extent& right);
+  static bool tryMerge(Extent* records, uint64_t* count_ptr, const Extent& extent);
+  static void insertSorted(Extent* records, uint64_t* count_ptr, const Extent& record);
+  static void splitNode(Blocks* blocks, ExtentBlock& node, const Extent& pending, std::vector<id_t>* free_nodes,
+                        Extent* sibling_record_ptr);
+
+  /*!
+   * frees blocks of the subtree, physically contiguous blocks are gathered in _pending_ptr_ and freed at once
+   */
+  static int freeSubtree(Blocks* blocks, const Extent* records, uint64_t count, uint64_t depth,
+                         BlockRange* pending_ptr, uint64_t* freed_num_ptr);
+
+  /*!
+   * removes records of the subtree starting from _index_, frees their blocks like freeSubtree
+   */
+  static int truncateSubtree(Blocks* blocks, Extent* records, uint64_t* count_ptr, uint64_t depth, uint64_t index,
+                             BlockRange* pending_ptr, uint64_t* freed_num_ptr);
+  static int freePending(Blocks* blocks, BlockRange* pending_ptr, const BlockRange& range);
+
+  /*!
+   * @param records_ptr where to store records of the leaf that contains _index_
+   * @param next_start_ptr where to store logical start of the first extent after the found one, size() if none
+   * @param count_ptr_ptr where to store pointer to record count of the leaf, may be nullptr
+   * @return position of the last extent in the leaf that starts at or before _index_ (0 if there is no such one)
+   */
+  uint64_t findLeaf(Blocks* blocks, uint64_t index, Extent** records_ptr, uint64_t* next_start_ptr,
+                    uint64_t** count_ptr_ptr = nullptr);
+  const Extent& findExtent(Blocks* blocks, uint64_t index);
+
+  /*!
+   * @return number of nodes that may need to be allocated to insert record at _logical_index_
+   */
+  uint64_t countNodesToInsert(Blocks* blocks, uint64_t logical_index);
+
+  /*!
+   * @note on failure the list isn't changed
+   */
+  int insertExtent(Blocks* blocks, const Extent& extent);
+  /*!
+   * like insertExtent, but new nodes are taken from _free_nodes_, there should be enough of them (see
+   * countNodesToInsert)
+   */
+  void insertExtent(Blocks* blocks, const Extent& extent, std::vector<id_t>* free_nodes);
+
+  /*!
+   * inserts _extent_ into the subtree of the node, new nodes are taken from _free_nodes_
+   * @param overflow_ptr set to true if the node itself is full and _pending_ptr_ must be placed by the caller
+   */
+  static void insertIntoNode(Blocks* blocks, Extent* records, uint64_t* count_ptr, uint64_t capacity, uint64_t depth,
+                             const Extent& extent, std::vector<id_t>* free_nodes, bool* overflow_ptr,
+                             Extent* pending_ptr);
+
  private:
   uint64_t size_{0};
+  uint64_t depth_{0};
+  uint64_t root_count_{0};
 
-  id_t block_ids_[ILIST_ZERO_INDIRECTION]{};
-  id_t level1_id_{0};
-  id_t level2_id_{0};
+  Extent root_[ILIST_ROOT_EXTENT_COUNT]{};
 };
 
-}  // namespace fspp::internal
\ No newline at end of file
+}  // namespace fspp::internal
@@ -1,79 +1,181 @@
 #pragma once
 
-#include <cstdint>
-#include "bitset.h"
-#include "block.h"
+#include <sys/uio.h>
 
-#ifdef NORMAL_ILIST
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
 
+#include "block.h"
+#include "fragment.h"
+#include "group.h"
 #include "ilist.h"
-#else
-namespace fspp::internal {
-class InodesList {
- public:
-  [[nodiscard]] uint64_t getBlockIdByIndex(uint64_t index) const {
-    assert(index < size_);
-    return block_ids_[index];
-  }
-
-  [[nodiscard]] uint64_t max_size() const {
-    return INODE_MAX_BLOCK_COUNT;
-  }
-
-  [[nodiscard]] uint64_t size() const {
-    return size_;
-  }
-
-  void clear() {
-    size_ = 0;
-  }
-
-  // aaaaaaa
-  void setSize(uint64_t new_size) {
-    size_ = new_size;
-  }
-
-  int addBlock(uint64_t block_id) {
-    if (size_ + 1 == INODE_MAX_BLOCK_COUNT) {
-      return -1;
-    }
-
-    block_ids_[size_++] = block_id;
-    return 0;
-  }
-
- private:
-  uint64_t size_{0};
-  uint64_t block_ids_[INODE_MAX_BLOCK_COUNT];
-};
-}  // namespace fspp::internal
-#endif
 
 namespace fspp::internal {
 
 struct Link {
   bool is_alive{true};
+  // type of the child is kept in the link, so listing doesn't read inodes
+  bool is_dir{false};
   char name[MAX_LINK_NAME_LEN + 1]{};
+  // for dead links: index + 1 of the next dead link in the free list of the directory, 0 for the last one
   uint64_t inode_id{0};
 };
 
+const uint64_t LINKS_IN_BLOCK_COUNT = BLOCK_SIZE / sizeof(Link);
+
 struct Inode {
   bool is_dir{false};
+  // file content is stored in place of _inodes_list_ while it fits there
+  bool has_inline_data{false};
+  // file content is stored in fragments of a shared block, their location is stored in place of _inodes_list_
+  bool has_fragment_data{false};
+  bool has_dir_index{false};
+  // number of allocated data blocks, holes aren't counted
   uint64_t blocks_count{0};
   uint64_t file_size{0};
   InodesList inodes_list;
+
+  // hash index of a large directory is stored in _dir_index_block_count_ contiguous blocks from _dir_index_start_
+  id_t dir_index_start{0};
+  uint64_t dir_index_block_count{0};
+  uint64_t dir_index_entry_count{0};
+  // entries and tombstones
+  uint64_t dir_index_used_slot_count{0};
+  // index isn't built again until the directory has this many links, set when a build fails for lack of space
+  uint64_t dir_index_retry_link_count{0};
+
+  // dead links of a directory are chained into a free list, so inserts don't look for them
+  uint64_t dir_free_link_count{0};
+  // index + 1 of the first dead link, 0 if there are none
+  uint64_t dir_free_link_head{0};
+
+  // inode is unlinked and waits for the reclaimer in the orphan list
+  bool is_orphan{false};
+  // id + 1 of the next orphan, 0 for the last one
+  uint64_t orphan_next{0};
+};
+
+const uint64_t INODE_INLINE_DATA_SIZE = sizeof(InodesList);
+
+static_assert(sizeof(FragmentRun) <= sizeof(InodesList));
+
+// slot of directory index holds (name hash << 32) | (link index + 1)
+const uint64_t DIR_INDEX_EMPTY_SLOT = 0;
+const uint64_t DIR_INDEX_TOMBSTONE = 0xFFFFFFFF00000000;
+
+/*!
+ * fields of an inode that may be read without its lock
+ */
+struct InodeStat {
+  bool is_dir{false};
+  uint64_t file_size{0};
+  uint64_t blocks_count{0};
+};
+
+/*!
+ * lock and version of an inode, version is odd while the inode is locked exclusively (seqlock)
+ *
+ * stat_version is a seqlock of the stat fields alone, it's odd only while one of them is stored, so stats are read
+ * without waiting for the whole change of the inode
+ */
+struct InodeSync {
+  std::shared_mutex mutex;
+  std::atomic<uint64_t> version{0};
+  std::atomic<uint64_t> stat_version{0};
+};
+
+/*!
+ * shared or exclusive lock of an inode, released on destruction
+ *
+ * exclusive lock bumps version of the inode when it's taken and when it's released
+ */
+class InodeLock {
+ public:
+  InodeLock() = default;
+  InodeLock(InodeSync* sync, bool is_exclusive);
+  /*!
+   * takes exclusive lock only if it's free, check ownsLock
+   */
+  InodeLock(InodeSync* sync, std::try_to_lock_t);
+  ~InodeLock();
+
+  InodeLock(const InodeLock& other) = delete;
+  InodeLock& operator=(const InodeLock& other) = delete;
+  InodeLock(InodeLock&& other) noexcept;
+  InodeLock& operator=(InodeLock&& other) noexcept;
+
+  [[nodiscard]] bool ownsLock() const {
+    return sync_ != nullptr;
+  }
+
+  [[nodiscard]] bool isExclusive() const {
+    return is_exclusive_;
+  }
+
+  void unlock();
+
+ private:
+  void beginChange();
+
+ private:
+  InodeSync* sync_{nullptr};
+  bool is_exclusive_{false};
 };
 
 /*!
  * Does all work that connected to inodes
+ *
+ * Inodes aren't synchronized themselves: callers hold lock of an inode (lockInode), shared one to read it and
+ * exclusive one to change it or links of a directory. Allocation of inodes, blocks and fragments is synchronized
+ * inside of the allocators, so operations on different inodes run in parallel.
+ *
+ * Readers may also go without the lock: they take version of the inode, copy what they need and check that the
+ * version is still the same (isVersionCurrent), otherwise the copy may be torn and the read is repeated. Blocks stay
+ * mapped when they are freed, so such reads never fault, and *Unlocked methods check everything they take from
+ * blocks, so a tree that is being changed is never followed outside of them.
  */
 class Inodes {
  public:
   Inodes() = default;
-  [[maybe_unused]] Inodes(const uint64_t* inode_num_ptr, uint64_t* free_inode_num_ptr, uint8_t* bit_set_bytes,
-                          Blocks* blocks, Inode* inode_bytes);
-  Inodes(void* inodes_ptr_start, Blocks* blocks, uint64_t* free_inode_num_ptr, BitSet inodes_bitset);
+  Inodes(void* inodes_ptr_start, Blocks* blocks, Fragments* fragments, AllocationGroups inode_groups);
   Inode& getInodeById(uint64_t inode_id);
+  uint64_t getInodeId(const Inode* inode_ptr) const;
+
+  /*!
+   * locks are kept in memory, one per inode
+   */
+  InodeLock lockInode(uint64_t inode_id, bool is_exclusive);
+  InodeLock tryLockInode(uint64_t inode_id);
+
+  /*!
+   * @return version to check a read without the lock with, odd one never passes the check
+   */
+  uint64_t readVersion(uint64_t inode_id) const;
+  bool isVersionCurrent(uint64_t inode_id, uint64_t version) const;
+
+  /*!
+   * version counter itself, for checks that are done under other locks (see DentryCache)
+   */
+  const std::atomic<uint64_t>& getVersion(uint64_t inode_id) const {
+    return inode_syncs_[inode_id].version;
+  }
+
+  /*!
+   * copies the inode without its lock, the copy should be checked with isVersionCurrent
+   */
+  void copyInode(uint64_t inode_id, Inode* inode_copy_ptr) const;
+
+  /*!
+   * reads the fields without the lock, they are checked with stat_version of the inode, so they are taken at one moment
+   * even while the inode is being changed
+   * @note caller should make sure the inode isn't reclaimed and reused meanwhile (e.g. its link is unchanged)
+   */
+  InodeStat statUnlocked(uint64_t inode_id) const;
 
   /*!
    * attempts to read up to _count_ bytes from file associated with _inode_ at _offset_ (in bytes) into _buffer_
@@ -85,6 +187,20 @@ class Inodes {
    */
   int read(Inode* inode_ptr, void* buffer, uint64_t offset, uint64_t count) const;
 
+  /*!
+   * like read, but works on a copy of the inode (see copyInode), its blocks may be changed concurrently
+   * @return number of bytes read, -1 if blocks are inconsistent, the result is valid only if the version is current
+   */
+  int readUnlocked(Inode* inode_copy_ptr, void* buffer, uint64_t offset, uint64_t count) const;
+
+  /*!
+   * like read, but instead of copying appends ranges of mapped blocks that hold up to _count_ bytes at _offset_ to
+   * _ranges_, physically contiguous blocks make a single range, holes point to a shared zeroed buffer
+   * @note ranges are read-only and stay valid until the file is truncated or its blocks are reclaimed
+   * @return number of bytes covered by the appended ranges
+   */
+  int mapRange(Inode* inode_ptr, uint64_t offset, uint64_t count, std::vector<iovec>* ranges) const;
+
   /*!
    * attempts to write up to _count_ bytes to file associated with inode at _offset_ (in bytes) from _buffer_
    * @param buffer
@@ -95,28 +211,197 @@ class Inodes {
   int write(Inode* inode_ptr, const void* buffer, uint64_t offset, uint64_t count);
   int append(Inode* inode_ptr, const void* buffer, uint64_t count);
 
+  /*!
+   * allocates all blocks needed to store _size_ bytes at once, file size isn't changed
+   * @note allocated blocks are unwritten and read as zeros until something is written to them
+   * @return 0 on success, -1 if there is not enough space (nothing is allocated then)
+   */
+  int reserve(Inode* inode_ptr, uint64_t size);
+
+  /*!
+   * sets file size to _new_size_, blocks after the new end of file are freed, growing leaves a hole
+   * @return 0 on success, -1 on error
+   */
+  int truncate(Inode* inode_ptr, uint64_t new_size);
+
+  /*!
+   * @param result_ptr where to store offset of the first data byte at or after _offset_
+   * @return 0 on success, -1 if there is no data between _offset_ and the end of file
+   */
+  int seekData(Inode* inode_ptr, uint64_t offset, uint64_t* result_ptr);
+
+  /*!
+   * @param result_ptr where to store offset of the first hole byte at or after _offset_, end of file counts as hole
+   * @return 0 on success, -1 if _offset_ is beyond the end of file
+   */
+  int seekHole(Inode* inode_ptr, uint64_t offset, uint64_t* result_ptr);
+
+  /*!
+   * @return whether growing the file to _size_ frees fragments that it outgrows
+   */
+  static bool growFreesData(Inode& inode, uint64_t size);
+  /*!
+   * @return whether truncating the file to _new_size_ frees some of its blocks or fragments
+   */
+  static bool truncateFreesData(Inode& inode, uint64_t new_size);
+
+  /*!
+   * content of _to_ptr_ is freed, then it takes over content of _from_ptr_, which becomes an empty inline file
+   * @note both inodes should be files
+   */
+  void moveData(Inode* from_ptr, Inode* to_ptr);
+
+  /*!
+   * writes first _size_ bytes of _from_ptr_ to _to_ptr_ at the same offsets and sets its size to _size_, holes and
+   * unwritten blocks aren't copied
+   * @note _to_ptr_ should be empty or hold a part of the same copy
+   * @return 0 on success, -1 if there is not enough space
+   */
+  int copyData(Inode* from_ptr, Inode* to_ptr, uint64_t size);
+
  public:
   int addBlockToInode(Inode& inode, uint64_t block_id);
-  uint64_t createInode();
+  /*!
+   * files are placed in the group of their parent, directories are spread to the emptiest group
+   */
+  int createInode(uint64_t parent_inode_id, bool is_dir, uint64_t* created_id);
   void deleteInode(uint64_t inode_id);
 
   /*!
+   * creates inode and links it to the directory, the link takes the first dead link of the free list if there is one
+   * @param created_id_ptr where to store id of the created inode
+   * @note doesn't check possible existence of the entry
+   */
+  int addDirectoryEntry(Inode* inode_ptr, std::string_view name, bool is_dir, uint64_t* created_id_ptr);
+
+  /*!
+   * links existing inode to the directory like addDirectoryEntry
    * @note doesn't check possible existence of the entry
    */
-  int addDirectoryEntry(Inode* inode_ptr, const char* name, bool is_dir);
+  int linkDirectoryEntry(Inode* inode_ptr, std::string_view name, bool is_dir, uint64_t inode_id);
+
+  /*!
+   * points alive link with _link_index_ to another inode, the previous one isn't deleted
+   */
+  int relinkDirectoryEntry(Inode* inode_ptr, uint64_t link_index, uint64_t inode_id);
+
+  /*!
+   * uses hash index of the directory if it has one, otherwise scans all links
+   * @param link_ptr where to store the found link
+   * @param link_index_ptr where to store index of the found link in the directory, may be nullptr
+   * @return 0 on success, -1 if there is no alive entry with _name_
+   */
+  int findDirectoryEntry(Inode* inode_ptr, std::string_view name, Link* link_ptr, uint64_t* link_index_ptr);
+
+  /*!
+   * like findDirectoryEntry, but works on a copy of the inode like readUnlocked
+   */
+  int findDirectoryEntryUnlocked(Inode* inode_copy_ptr, std::string_view name, Link* link_ptr) const;
 
-  [[maybe_unused]] static int gcLaterRename(uint64_t inode_id);
+  /*!
+   * marks link as dead and puts it to the free list, the child inode isn't deleted
+   * @note directory is compacted when most of its links are dead
+   */
+  int removeDirectoryEntry(Inode* inode_ptr, uint64_t link_index);
+
+  /*!
+   * moves alive links to the beginning of the directory and frees blocks after them, free list becomes empty
+   * @note indices of links change, hash index is rebuilt
+   */
+  int compactDirectory(Inode* inode_ptr);
+
+  /*!
+   * frees up to _max_block_count_ data blocks from the end of the file, big files are deleted in such steps
+   * @param is_empty_ptr set to true when the file has no data blocks left
+   * @note file size is reduced to the freed blocks
+   */
+  int freeTailBlocks(Inode* inode_ptr, uint64_t max_block_count, bool* is_empty_ptr);
+
+  /*!
+   * fragment bitmaps aren't stored in the ffile, so they are rebuilt from inodes on mount
+   */
+  void restoreFragments();
 
  private:
-  static int clearInode(Inode* inode_ptr);
-  Block& getBlockByIndex(Inode& inode, uint64_t index) const;
-  int extend(Inode& inode, uint64_t new_size);
+  int clearInode(Inode* inode_ptr);
+
+  /*!
+   * frees blocks or fragments of the file, its content should be dropped by the caller then
+   */
+  void freeData(Inode& inode);
+
+  /*!
+   * stat fields are changed only through these, see statUnlocked
+   */
+  void setIsDir(Inode& inode, bool is_dir);
+  void setFileSize(Inode& inode, uint64_t file_size);
+  void setBlocksCount(Inode& inode, uint64_t blocks_count);
+  InodeSync& beginStatChange(const Inode& inode);
+  static void endStatChange(InodeSync& sync);
+
+  static uint8_t* getInlineData(Inode& inode) {
+    return reinterpret_cast<uint8_t*>(&inode.inodes_list);
+  }
+
+  static FragmentRun& getFragmentRun(Inode& inode) {
+    return *reinterpret_cast<FragmentRun*>(&inode.inodes_list);
+  }
+
+  static bool hasSmallData(const Inode& inode) {
+    return inode.has_inline_data || inode.has_fragment_data;
+  }
+
+  /*!
+   * @return content of inline or fragment file
+   */
+  uint8_t* getSmallData(Inode& inode) const;
+  static uint64_t getSmallDataCapacity(Inode& inode);
+
+  /*!
+   * moves content of inline or fragment file to fragments that fit _size_ bytes, or to blocks if a block is needed
+   * @note on failure the inode isn't changed
+   */
+  int growSmallData(Inode& inode, uint64_t size);
+
+  /*!
+   * @return first block of the block group matching inode's group
+   */
+  id_t getBlockHint(Inode& inode);
+
+  static uint32_t hashName(std::string_view name);
+  static uint64_t getDirIndexBlockCount(uint64_t link_count);
+  uint64_t* getDirIndexSlots(Inode& inode) const;
+
+  /*!
+   * adds the link written at _link_index_ to the index, index is built or rebuilt when needed
+   * @note index is only a lookup accelerator: if there is no space for it, directory is left without index
+   */
+  void indexDirectoryEntry(Inode& inode, std::string_view name, uint64_t link_index);
+  void unindexDirectoryEntry(Inode& inode, uint32_t hash, uint64_t link_index);
+
+  /*!
+   * builds index of _block_count_ blocks from all alive links of the directory, old index is freed
+   */
+  int buildDirIndex(Inode& inode, uint64_t block_count);
+  void freeDirIndex(Inode& inode);
+
+  /*!
+   * allocates unwritten blocks for all holes between _first_index_ and _end_index_
+   * @note on failure no hole is filled
+   */
+  int allocateBlocks(Inode& inode, uint64_t first_index, uint64_t end_index);
+  // continues the run of blocks before _index_ if possible
+  id_t getHoleHint(Inode& inode, uint64_t index);
+  // gives back blocks that weren't attached to an inode
+  void freeRanges(const std::vector<BlockRange>& ranges);
+  int seekRun(Inode& inode, uint64_t offset, bool data, uint64_t* result_ptr);
 
  private:
   Inode* inodes_ptr_start_{nullptr};
   Blocks* blocks_{nullptr};
-  uint64_t* free_inode_num_ptr_{nullptr};
-  BitSet bit_set_{};
+  Fragments* fragments_{nullptr};
+  AllocationGroups groups_{};
+  std::unique_ptr<InodeSync[]> inode_syncs_;
 };
 
 }  // namespace fspp::internal
\ No newline at end of file
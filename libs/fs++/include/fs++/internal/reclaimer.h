@@ -0,0 +1,127 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "dcache.h"
+#include "inode.h"
+
+namespace fspp::internal {
+
+/*!
+ * where the orphan list lives in the ffile
+ */
+struct OrphanList {
+  // ids + 1 of the first and the last orphan, 0 if the list is empty
+  uint64_t* head_ptr{nullptr};
+  uint64_t* tail_ptr{nullptr};
+  uint64_t* count_ptr{nullptr};
+};
+
+/*!
+ * Frees deleted inodes in the background.
+ *
+ * Deletion only unlinks an inode and appends it to the orphan list stored in the ffile. Reclaimer thread frees
+ * orphans from the head of the list in batches of bounded size, so the list stays consistent between batches and
+ * reclaiming resumes on the next mount after a crash. Children of a deleted directory become orphans themselves.
+ *
+ * Inodes that are open (pinned) aren't reclaimed until they are closed, holders of blocks freed from a mapped inode
+ * aren't reclaimed until it's unmapped. Reclaimer never waits for inode locks: an orphan that is locked by someone
+ * (e.g. a path walk that entered a directory before it was deleted) is retried after RECLAIM_RETRY_INTERVAL, so
+ * callers may wait for the reclaimer while holding inode locks.
+ */
+class Reclaimer {
+ public:
+  Reclaimer() = default;
+  ~Reclaimer();
+
+  Reclaimer(const Reclaimer& other) = delete;
+  Reclaimer& operator=(const Reclaimer& other) = delete;
+
+  /*!
+   * starts reclaimer thread, orphans left from the previous mount are reclaimed first
+   * @param dentry_cache entries of reclaimed directories are dropped from it
+   */
+  void start(Inodes* inodes, DentryCache* dentry_cache, OrphanList orphans);
+  void stop();
+
+  /*!
+   * appends unlinked inode to the orphan list
+   */
+  void addOrphan(uint64_t inode_id);
+
+  /*!
+   * @note inode should be locked by the caller, so it can't be reclaimed before it's pinned
+   */
+  void pin(uint64_t inode_id);
+  void unpin(uint64_t inode_id);
+
+  bool isOrphan(uint64_t inode_id);
+
+  /*!
+   * counts handles that mapped the inode, see FileSystem::mapInode
+   * @note inode should be locked by the caller, like for pin
+   */
+  void map(uint64_t inode_id);
+  void unmap(uint64_t inode_id);
+  bool isMapped(uint64_t inode_id);
+
+  /*!
+   * _holder_id_ should be a pinned orphan, it's unpinned when _inode_id_ is unmapped (at once if it isn't mapped)
+   */
+  void holdUntilUnmapped(uint64_t inode_id, uint64_t holder_id);
+
+  /*!
+   * blocks until all orphans that aren't pinned or locked are reclaimed
+   */
+  void waitForIdle();
+
+ private:
+  struct Mapping {
+    // number of handles that mapped the inode
+    uint64_t count{0};
+    // orphans that hold blocks freed from the inode while it's mapped
+    std::vector<uint64_t> holder_ids;
+  };
+
+ private:
+  void run();
+
+  /*!
+   * @param prev_id_ptr where to store id + 1 of the orphan before the found one, 0 if it's the head
+   * @param lock_ptr where to store exclusive lock of the found orphan
+   * @param has_busy_ptr set to true if some orphan was skipped because it's locked
+   * @return whether there is an orphan that isn't pinned or locked
+   */
+  bool findReclaimable(uint64_t* inode_id_ptr, uint64_t* prev_id_ptr, InodeLock* lock_ptr, bool* has_busy_ptr);
+
+  /*!
+   * frees one batch of the orphan's blocks or orphans a batch of its children
+   * @return whether nothing but the inode itself is left
+   */
+  bool reclaimStep(uint64_t inode_id);
+
+  void addOrphanLocked(uint64_t inode_id);
+  void removeOrphanLocked(uint64_t inode_id, uint64_t prev_id);
+
+ private:
+  Inodes* inodes_{nullptr};
+  DentryCache* dentry_cache_{nullptr};
+  OrphanList orphans_;
+
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable idle_cv_;
+  bool is_stopped_{false};
+  bool is_idle_{true};
+  // number of open handles of each pinned inode
+  std::unordered_map<uint64_t, uint64_t> pins_;
+  std::unordered_map<uint64_t, Mapping> mappings_;
+  std::thread thread_;
+};
+
+}  // namespace fspp::internal
@@ -5,28 +5,69 @@
 
 namespace fspp::internal {
 
+/*!
+ * link removal that is finished on the next mount if the previous one crashed in the middle of it
+ *
+ * it's recorded before the inode is orphaned (or before the new link of a move is written), so the ffile never keeps
+ * an orphan that is still linked or an inode with two links
+ */
+struct PendingUnlink {
+  // id + 1 of the directory that loses the link, 0 if nothing is pending
+  uint64_t parent_id{0};
+  uint64_t link_index{0};
+  // the link is removed on mount only if it's still alive and equal to this one
+  Link link;
+  // for moves: id + 1 of the directory that gets the new link, the old one is removed only if the new one is written
+  uint64_t new_parent_id{0};
+  char new_name[MAX_LINK_NAME_LEN + 1]{};
+  // id + 1 of the inode that becomes an orphan, 0 if there is none
+  uint64_t orphan_id{0};
+};
+
 struct SuperBlock {
   uint64_t block_num{0};
   uint64_t free_block_num{0};
   uint64_t inode_num{0};
   uint64_t free_inode_num{0};
+  uint64_t group_num{0};
+
+  // deleted inodes that aren't reclaimed yet, see Reclaimer
+  uint64_t orphan_head{0};
+  uint64_t orphan_tail{0};
+  uint64_t orphan_count{0};
+
+  // see FileSystem::finishPendingUnlink
+  PendingUnlink pending_unlink{};
 
   [[nodiscard]] std::size_t FileSystemSize() const {
     return BlocksOffset() + sizeof(Block) * block_num;
   }
 
-  [[nodiscard]] uint64_t InodeBitSetOffset() const {
+  [[nodiscard]] uint64_t BlockGroupsOffset() const {
     return sizeof(SuperBlock);
   }
 
+  [[nodiscard]] uint64_t InodeGroupsOffset() const {
+    return BlockGroupsOffset() + sizeof(uint64_t) * group_num;
+  }
+
+  [[nodiscard]] uint64_t InodeBitSetOffset() const {
+    return InodeGroupsOffset() + sizeof(uint64_t) * group_num;
+  }
+
   [[nodiscard]] uint64_t BlockBitSetOffset() const {
     return InodeBitSetOffset() + inode_num / 8;
   }
 
-  [[nodiscard]] uint64_t InodesOffset() const {
+  // bit per block that is split into fragments, see Fragments
+  [[nodiscard]] uint64_t FragmentBitSetOffset() const {
     return BlockBitSetOffset() + block_num / 8;
   }
 
+  [[nodiscard]] uint64_t InodesOffset() const {
+    return FragmentBitSetOffset() + block_num / 8;
+  }
+
   [[nodiscard]] uint64_t BlocksOffset() const {
     return InodesOffset() + sizeof(Inode) * inode_num;
   }
@@ -1,11 +1,17 @@
 #include "fs++/internal/bitset.h"
 
+#include <algorithm>
+#include <bit>
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
 
 namespace fspp::internal {
 
+static_assert(std::endian::native == std::endian::little, "bitset bytes are accessed as 64-bit words");
+
+static const uint64_t FULL_WORD = ~uint64_t{0};
+
 BitSet::BitSet() {
   has_ownership_ = false;
   element_num_ = 0;
@@ -13,25 +19,34 @@ BitSet::BitSet() {
 }
 
 BitSet::BitSet(uint64_t element_num) : has_ownership_(true), element_num_(element_num) {
-  assert(element_num_ % 8 == 0);
+  assert(element_num_ % 64 == 0);
 
   uint64_t bitset_size = element_num_ / 8;
   bytes_ = new uint8_t[bitset_size];
   memset(bytes_, 0, bitset_size);
+
+  buildSummary();
 }
 
 BitSet::BitSet(uint64_t element_num, uint8_t* bytes) : has_ownership_(false), element_num_(element_num), bytes_(bytes) {
-  assert(element_num_ % 8 == 0);
+  assert(element_num_ % 64 == 0);
+  assert(reinterpret_cast<uintptr_t>(bytes_) % alignof(uint64_t) == 0);
+
+  buildSummary();
 }
 
 BitSet::BitSet(BitSet&& other) noexcept {
   has_ownership_ = other.has_ownership_;
   element_num_ = other.element_num_;
   bytes_ = other.bytes_;
+  summary_ = std::move(other.summary_);
+  cursor_ = other.cursor_;
 
   other.has_ownership_ = false;
   other.element_num_ = 0;
   other.bytes_ = nullptr;
+  other.summary_.clear();
+  other.cursor_ = 0;
 }
 
 BitSet& BitSet::operator=(BitSet&& other) noexcept {
@@ -42,10 +57,14 @@ BitSet& BitSet::operator=(BitSet&& other) noexcept {
   has_ownership_ = other.has_ownership_;
   element_num_ = other.element_num_;
   bytes_ = other.bytes_;
+  summary_ = std::move(other.summary_);
+  cursor_ = other.cursor_;
 
   other.has_ownership_ = false;
   other.element_num_ = 0;
   other.bytes_ = nullptr;
+  other.summary_.clear();
+  other.cursor_ = 0;
 
   return *this;
 }
@@ -57,74 +76,231 @@ BitSet::~BitSet() {
 }
 
 void BitSet::setBit(uint64_t index) {
-  uint8_t* byte_ptr = getByteByIndex(index);
-  assert(byte_ptr != nullptr);
+  assert(index < element_num_);
+
+  uint64_t& word = levelWords(-1)[index / 64];
+  word |= uint64_t{1} << (index % 64);
 
-  *byte_ptr |= bitmaskByBitIndex(index % 8);
+  if (word == FULL_WORD) {
+    markWordFull(index / 64);
+  }
 }
 
 void BitSet::clearBit(uint64_t index) {
-  uint8_t* byte_ptr = getByteByIndex(index);
-  assert(byte_ptr != nullptr);
+  assert(index < element_num_);
+
+  uint64_t& word = levelWords(-1)[index / 64];
+  bool was_full = word == FULL_WORD;
+  word &= ~(uint64_t{1} << (index % 64));
 
-  uint8_t inverted_mask = ~bitmaskByBitIndex(index % 8);
-  *byte_ptr &= inverted_mask;
+  if (was_full) {
+    markWordNotFull(index / 64);
+  }
 }
 
 uint8_t BitSet::getBit(uint64_t index) {
-  uint8_t* byte_ptr = getByteByIndex(index);
-  assert(byte_ptr != nullptr);
+  assert(index < element_num_);
 
-  uint8_t bit = *byte_ptr & bitmaskByBitIndex(index % 8);
-  return (bit == 0) ? 0 : 1;
+  return (levelWords(-1)[index / 64] >> (index % 64)) & 1;
 }
 
 uint64_t BitSet::findCleanBit() {
-  for (uint64_t index = 0; index < element_num_ / 8; ++index) {
-    if (bytes_[index] == 0xff) {
-      continue;
+  uint64_t index;
+  if (findCleanBit(cursor_, &index) < 0 && findCleanBit(0, &index) < 0) {
+    std::abort();
+  }
+
+  cursor_ = index;
+  return index;
+}
+
+int BitSet::findCleanBit(uint64_t from, uint64_t* result_ptr) {
+  if (element_num_ == 0) {
+    return -1;
+  }
+
+  return findZeroFrom(-1, from, result_ptr) ? 0 : -1;
+}
+
+int BitSet::findCleanRun(uint64_t from, uint64_t len, uint64_t* result_ptr) {
+  assert(len != 0);
+
+  uint64_t run_start;
+  while (findCleanBit(from, &run_start) == 0) {
+    uint64_t run_len = cleanRunLength(run_start, len);
+    if (run_len == len) {
+      *result_ptr = run_start;
+      return 0;
+    }
+
+    // bit right after the run is set, skip it too
+    from = run_start + run_len + 1;
+  }
+
+  return -1;
+}
+
+uint64_t BitSet::cleanRunLength(uint64_t from, uint64_t max_len) {
+  return runLength(from, max_len, 0);
+}
+
+uint64_t BitSet::setRunLength(uint64_t from, uint64_t max_len) {
+  return runLength(from, max_len, FULL_WORD);
+}
+
+void BitSet::setRange(uint64_t from, uint64_t len) {
+  assert(from + len <= element_num_);
+
+  uint64_t* words = levelWords(-1);
+  for (uint64_t index = from; index < from + len;) {
+    uint64_t bit_offset = index % 64;
+    uint64_t bits_in_word = std::min(64 - bit_offset, from + len - index);
+    uint64_t mask = (bits_in_word == 64) ? FULL_WORD : ((uint64_t{1} << bits_in_word) - 1) << bit_offset;
+
+    uint64_t& word = words[index / 64];
+    word |= mask;
+    if (word == FULL_WORD) {
+      markWordFull(index / 64);
     }
 
-    for (uint64_t bit_index = 0; bit_index < 8; ++bit_index) {
-      uint64_t exact_index = index * 8 + bit_index;
-      if (getBit(exact_index) == 0) {
-        return exact_index;
+    index += bits_in_word;
+  }
+}
+
+void BitSet::clearRange(uint64_t from, uint64_t len) {
+  assert(from + len <= element_num_);
+
+  uint64_t* words = levelWords(-1);
+  for (uint64_t index = from; index < from + len;) {
+    uint64_t bit_offset = index % 64;
+    uint64_t bits_in_word = std::min(64 - bit_offset, from + len - index);
+    uint64_t mask = (bits_in_word == 64) ? FULL_WORD : ((uint64_t{1} << bits_in_word) - 1) << bit_offset;
+
+    uint64_t& word = words[index / 64];
+    bool was_full = word == FULL_WORD;
+    word &= ~mask;
+    if (was_full) {
+      markWordNotFull(index / 64);
+    }
+
+    index += bits_in_word;
+  }
+}
+
+void BitSet::buildSummary() {
+  summary_.clear();
+  cursor_ = 0;
+
+  for (int64_t level = 0; levelBitNum(level - 1) > 64; ++level) {
+    uint64_t bit_num = levelBitNum(level);
+    std::vector<uint64_t> words((bit_num + 63) / 64, 0);
+
+    // bits past the end are marked as full, so search never stops on them
+    if (bit_num % 64 != 0) {
+      words.back() = FULL_WORD << (bit_num % 64);
+    }
+
+    const uint64_t* lower_words = levelWords(level - 1);
+    for (uint64_t i = 0; i < bit_num; ++i) {
+      if (lower_words[i] == FULL_WORD) {
+        words[i / 64] |= uint64_t{1} << (i % 64);
       }
     }
+
+    summary_.push_back(std::move(words));
   }
+}
+
+void BitSet::markWordFull(uint64_t word_index) {
+  for (auto& level : summary_) {
+    uint64_t& word = level[word_index / 64];
+    word |= uint64_t{1} << (word_index % 64);
+
+    if (word != FULL_WORD) {
+      return;
+    }
 
-  std::abort();
+    word_index /= 64;
+  }
 }
 
-uint8_t BitSet::bitmaskByBitIndex(uint8_t bit_index) {
-  switch (bit_index) {
-    case 0:
-      return 0x1;
-    case 1:
-      return 0x2;
-    case 2:
-      return 0x4;
-    case 3:
-      return 0x8;
-    case 4:
-      return 0x10;
-    case 5:
-      return 0x20;
-    case 6:
-      return 0x40;
-    case 7:
-      return 0x80;
-    default:
-      std::abort();
+void BitSet::markWordNotFull(uint64_t word_index) {
+  for (auto& level : summary_) {
+    uint64_t& word = level[word_index / 64];
+    bool was_full = word == FULL_WORD;
+    word &= ~(uint64_t{1} << (word_index % 64));
+
+    if (!was_full) {
+      return;
+    }
+
+    word_index /= 64;
   }
 }
 
-uint8_t* BitSet::getByteByIndex(uint64_t index) {
-  if (index >= element_num_) {
-    return nullptr;
+uint64_t* BitSet::levelWords(int64_t level) {
+  if (level < 0) {
+    return reinterpret_cast<uint64_t*>(bytes_);
+  }
+
+  return summary_[level].data();
+}
+
+uint64_t BitSet::levelBitNum(int64_t level) const {
+  uint64_t bit_num = element_num_;
+  for (int64_t i = -1; i < level; ++i) {
+    bit_num = (bit_num + 63) / 64;
+  }
+
+  return bit_num;
+}
+
+bool BitSet::findZeroFrom(int64_t level, uint64_t from, uint64_t* result_ptr) {
+  if (from >= levelBitNum(level)) {
+    return false;
+  }
+
+  uint64_t* words = levelWords(level);
+  uint64_t word_index = from / 64;
+  uint64_t clean_bits = ~words[word_index] & (FULL_WORD << (from % 64));
+
+  if (clean_bits == 0) {
+    // top level is a single word, nothing left to look at
+    if (level + 1 == static_cast<int64_t>(summary_.size())) {
+      return false;
+    }
+
+    // the first not full word after the current one is the first clean bit one level above
+    if (!findZeroFrom(level + 1, word_index + 1, &word_index)) {
+      return false;
+    }
+
+    clean_bits = ~words[word_index];
+    assert(clean_bits != 0);
+  }
+
+  *result_ptr = word_index * 64 + std::countr_zero(clean_bits);
+  return true;
+}
+
+uint64_t BitSet::runLength(uint64_t from, uint64_t max_len, uint64_t invert_mask) {
+  const uint64_t* words = levelWords(-1);
+
+  uint64_t run_len = 0;
+  for (uint64_t index = from; run_len < max_len && index < element_num_;) {
+    uint64_t bits_left_in_word = 64 - index % 64;
+    uint64_t word_run_len =
+        std::min<uint64_t>(std::countr_zero((words[index / 64] ^ invert_mask) >> (index % 64)), bits_left_in_word);
+
+    run_len += word_run_len;
+    index += word_run_len;
+
+    if (word_run_len != bits_left_in_word) {
+      break;
+    }
   }
 
-  return &bytes_[index / 8];
+  return std::min(run_len, max_len);
 }
 
 }  // namespace fspp::internal
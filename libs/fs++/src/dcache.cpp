@@ -0,0 +1,112 @@
+#include "fs++/internal/dcache.h"
+
+#include <cassert>
+
+namespace fspp::internal {
+
+DentryCache::DentryCache(uint64_t capacity) : shard_capacity_(capacity / DENTRY_CACHE_SHARD_COUNT) {
+  assert(shard_capacity_ != 0);
+}
+
+DentryCache::LookupResult DentryCache::lookup(uint64_t parent_id, std::string_view name, uint64_t* child_id_ptr) {
+  KeyView key{parent_id, name};
+  Shard& shard = getShard(key);
+  std::lock_guard guard(shard.mutex);
+
+  auto it = shard.entries.find(key);
+  if (it == shard.entries.end()) {
+    return LookupResult::MISS;
+  }
+
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  if (it->second->child_id == NEGATIVE_ENTRY) {
+    return LookupResult::NOT_FOUND;
+  }
+
+  *child_id_ptr = it->second->child_id;
+  return LookupResult::FOUND;
+}
+
+void DentryCache::insert(uint64_t parent_id, std::string_view name, uint64_t child_id) {
+  assert(child_id != NEGATIVE_ENTRY);
+  put(parent_id, name, child_id);
+}
+
+void DentryCache::insertNegative(uint64_t parent_id, std::string_view name) {
+  put(parent_id, name, NEGATIVE_ENTRY);
+}
+
+void DentryCache::insert(uint64_t parent_id, std::string_view name, uint64_t child_id,
+                         const std::atomic<uint64_t>& parent_version, uint64_t version) {
+  assert(child_id != NEGATIVE_ENTRY);
+  put(parent_id, name, child_id, &parent_version, version);
+}
+
+void DentryCache::insertNegative(uint64_t parent_id, std::string_view name,
+                                 const std::atomic<uint64_t>& parent_version, uint64_t version) {
+  put(parent_id, name, NEGATIVE_ENTRY, &parent_version, version);
+}
+
+void DentryCache::invalidate(uint64_t parent_id, std::string_view name) {
+  KeyView key{parent_id, name};
+  Shard& shard = getShard(key);
+  std::lock_guard guard(shard.mutex);
+
+  auto it = shard.entries.find(key);
+  if (it == shard.entries.end()) {
+    return;
+  }
+
+  shard.lru.erase(it->second);
+  shard.entries.erase(it);
+}
+
+void DentryCache::forgetDirectory(uint64_t parent_id) {
+  for (Shard& shard : shards_) {
+    std::lock_guard guard(shard.mutex);
+
+    for (auto it = shard.lru.begin(); it != shard.lru.end();) {
+      if (it->key.parent_id != parent_id) {
+        ++it;
+        continue;
+      }
+
+      shard.entries.erase(it->key);
+      it = shard.lru.erase(it);
+    }
+  }
+}
+
+DentryCache::Shard& DentryCache::getShard(const KeyView& key) {
+  // low bits of the hash pick buckets inside of the shard
+  return shards_[(KeyHash()(key) >> 32) % DENTRY_CACHE_SHARD_COUNT];
+}
+
+void DentryCache::put(uint64_t parent_id, std::string_view name, uint64_t child_id,
+                      const std::atomic<uint64_t>* parent_version, uint64_t version) {
+  KeyView key{parent_id, name};
+  Shard& shard = getShard(key);
+  std::lock_guard guard(shard.mutex);
+
+  // the version is changed before invalidation, which takes the shard lock too, so either the check fails or the
+  // entry is invalidated after it's inserted
+  if (parent_version != nullptr && parent_version->load(std::memory_order_acquire) != version) {
+    return;
+  }
+
+  if (auto it = shard.entries.find(key); it != shard.entries.end()) {
+    it->second->child_id = child_id;
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    return;
+  }
+
+  if (shard.entries.size() == shard_capacity_) {
+    shard.entries.erase(shard.lru.back().key);
+    shard.lru.pop_back();
+  }
+
+  shard.lru.push_front({.key = {parent_id, std::string(name)}, .child_id = child_id});
+  shard.entries.emplace(shard.lru.front().key, shard.lru.begin());
+}
+
+}  // namespace fspp::internal
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstring>
 #include <fcntl.h>
 #include <unistd.h>
@@ -19,6 +20,30 @@ namespace fspp::internal {
 namespace in = internal;
 using internal::Link;
 
+static int initGroups(int ffile_fd, SuperBlock& superblock) {
+  auto* ffile_content = static_cast<uint8_t*>(
+      mmap64(nullptr, superblock.InodeBitSetOffset(), PROT_WRITE | PROT_READ, MAP_SHARED, ffile_fd, 0));
+
+  if (ffile_content == MAP_FAILED) {
+    perror("Can't mmap ffile for allocation groups initializing");
+    return -1;
+  }
+
+  auto* block_group_free_nums = reinterpret_cast<uint64_t*>(ffile_content + superblock.BlockGroupsOffset());
+  auto* inode_group_free_nums = reinterpret_cast<uint64_t*>(ffile_content + superblock.InodeGroupsOffset());
+  for (uint64_t group = 0; group < superblock.group_num; ++group) {
+    block_group_free_nums[group] = superblock.block_num / superblock.group_num;
+    inode_group_free_nums[group] = superblock.inode_num / superblock.group_num;
+  }
+
+  if (munmap(ffile_content, superblock.InodeBitSetOffset()) == -1) {
+    perror("munmap ffile failed");
+    return -1;
+  }
+
+  return 0;
+}
+
 static int initRootInode(int ffile_fd, SuperBlock& superblock) {
   auto* ffile_content = static_cast<uint8_t*>(
       mmap64(nullptr, superblock.FileSystemSize(), PROT_WRITE | PROT_READ, MAP_SHARED, ffile_fd, 0));
@@ -30,6 +55,7 @@ static int initRootInode(int ffile_fd, SuperBlock& superblock) {
 
   auto* superblock_ptr = reinterpret_cast<SuperBlock*>(ffile_content);
   --(superblock_ptr->free_inode_num);
+  --(reinterpret_cast<uint64_t*>(ffile_content + superblock.InodeGroupsOffset())[0]);
 
   auto* root_inode_ptr = reinterpret_cast<Inode*>(ffile_content + superblock.InodesOffset());
   root_inode_ptr->is_dir = true;
@@ -62,7 +88,8 @@ FileSystem::FileSystem(const std::string& ffile_path) {
     SuperBlock super_block = {.block_num = DEFAULT_BLOCK_COUNT,
                               .free_block_num = super_block.block_num,
                               .inode_num = DEFAULT_INODE_COUNT,
-                              .free_inode_num = super_block.inode_num};
+                              .free_inode_num = super_block.inode_num,
+                              .group_num = DEFAULT_GROUP_COUNT};
 
     if (ftruncate(fd_, super_block.FileSystemSize()) == -1) {
       FSC_HANDLE_ERROR("Truncation failed");
@@ -78,6 +105,10 @@ FileSystem::FileSystem(const std::string& ffile_path) {
       FSC_HANDLE_ERROR("munmap truncated file failed");
     }
 
+    if (initGroups(fd_, super_block) < 0) {
+      std::abort();
+    }
+
     if (initRootInode(fd_, super_block) < 0) {
       std::abort();
     }
@@ -103,21 +134,38 @@ FileSystem::FileSystem(const std::string& ffile_path) {
 
   super_block_ptr_ = reinterpret_cast<internal::SuperBlock*>(file_bytes_);
 
-  BitSet blocks_bitset(super_block_ptr_->block_num, file_bytes_ + super_block_ptr_->BlockBitSetOffset());
-  blocks_ = Blocks(file_bytes_ + super_block_ptr_->BlocksOffset(), &super_block_ptr_->free_block_num,
-                   std::move(blocks_bitset));
+  auto* block_group_free_nums = reinterpret_cast<uint64_t*>(file_bytes_ + super_block_ptr_->BlockGroupsOffset());
+  AllocationGroups block_groups(super_block_ptr_->block_num, super_block_ptr_->group_num,
+                                file_bytes_ + super_block_ptr_->BlockBitSetOffset(), &super_block_ptr_->free_block_num,
+                                block_group_free_nums);
+  blocks_ = Blocks(file_bytes_ + super_block_ptr_->BlocksOffset(), std::move(block_groups));
 
-  BitSet inodes_bitset(super_block_ptr_->inode_num, file_bytes_ + super_block_ptr_->InodeBitSetOffset());
-  inodes_ = Inodes(file_bytes_ + super_block_ptr_->InodesOffset(), &blocks_, &super_block_ptr_->free_inode_num,
-                   std::move(inodes_bitset));
+  auto* inode_group_free_nums = reinterpret_cast<uint64_t*>(file_bytes_ + super_block_ptr_->InodeGroupsOffset());
+  AllocationGroups inode_groups(super_block_ptr_->inode_num, super_block_ptr_->group_num,
+                                file_bytes_ + super_block_ptr_->InodeBitSetOffset(), &super_block_ptr_->free_inode_num,
+                                inode_group_free_nums);
+  fragments_ = Fragments(&blocks_, BitSet(super_block_ptr_->block_num,
+                                          file_bytes_ + super_block_ptr_->FragmentBitSetOffset()));
+  inodes_ = Inodes(file_bytes_ + super_block_ptr_->InodesOffset(), &blocks_, &fragments_, std::move(inode_groups));
+  inodes_.restoreFragments();
+  fragments_.freeEmptyBlocks();
+
+  // orphan of an interrupted unlink may already be in the list, it's kept until its link is removed
+  const uint64_t pending_orphan_id = super_block_ptr_->pending_unlink.orphan_id;
+  if (pending_orphan_id != 0) {
+    reclaimer_.pin(pending_orphan_id - 1);
+  }
 
-  //  blocks_ = Blocks(&super_block_ptr_->block_num, &super_block_ptr_->free_block_num,
-  //                           file_bytes_ + super_block_ptr_->BlockBitSetOffset(),
-  //                           reinterpret_cast<internal::Block*>(file_bytes_ + super_block_ptr_->BlocksOffset()));
+  // orphans left by the previous mount are reclaimed first
+  reclaimer_.start(&inodes_, &dentry_cache_,
+                   {.head_ptr = &super_block_ptr_->orphan_head,
+                    .tail_ptr = &super_block_ptr_->orphan_tail,
+                    .count_ptr = &super_block_ptr_->orphan_count});
 
-  //  inodes_ = Inodes(&super_block_ptr_->inode_num, &super_block_ptr_->free_inode_num,
-  //                   file_bytes_ + super_block_ptr_->InodeBitSetOffset(), &blocks_,
-  //                   reinterpret_cast<Inode*>(file_bytes_ + super_block_ptr_->InodesOffset()));
+  finishPendingUnlink();
+  if (pending_orphan_id != 0) {
+    reclaimer_.unpin(pending_orphan_id - 1);
+  }
 
   FSC_LOG("FSM", "inode bitset: " + std::to_string(super_block_ptr_->InodeBitSetOffset()));
   FSC_LOG("FSM", "block bitset: " + std::to_string(super_block_ptr_->BlockBitSetOffset()));
@@ -127,6 +175,7 @@ FileSystem::FileSystem(const std::string& ffile_path) {
 
 FileSystem::~FileSystem() {
   FSC_LOG("FSM", "Destroying fsm object.");
+  reclaimer_.stop();
   if (munmap(file_bytes_, super_block_ptr_->FileSystemSize()) == -1) {
     FSC_HANDLE_ERROR("Can't unmap ffile");
   }
@@ -134,104 +183,323 @@ FileSystem::~FileSystem() {
   close(fd_);
 }
 
-int FileSystem::deleteInode(uint64_t inode_id) {
-  inodes_.deleteInode(inode_id);
+int FileSystem::lookupFDE(const std::string& fde_path, bool lock_exclusively, uint64_t* inode_id_ptr,
+                          InodeLock* lock_ptr) {
+  uint64_t parent_id;
+  std::string_view name;
+  InodeLock parent_lock;
+  if (walkToParent(fde_path, /*create_parents=*/false, /*lock_exclusively=*/false, &parent_id, &name, &parent_lock) <
+      0) {
+    return -1;
+  }
+
+  if (name.empty()) {
+    // root is never unlinked, so it may be relocked in another mode
+    parent_lock.unlock();
+    *inode_id_ptr = 0;
+    *lock_ptr = inodes_.lockInode(0, lock_exclusively);
+    return 0;
+  }
+
+  if (lookupChild(getInodeById(parent_id), name, inode_id_ptr) < 0) {
+    return -1;
+  }
+
+  *lock_ptr = inodes_.lockInode(*inode_id_ptr, lock_exclusively);
   return 0;
 }
 
-int FileSystem::getFDEInodeId(std::string fde_path, uint64_t* result_ptr) {
-  if (fde_path == "/") {
-    *result_ptr = 0;
-    return 0;
+int FileSystem::statFDE(const std::string& fde_path, uint64_t* inode_id_ptr, InodeStat* stat_ptr) {
+  for (uint64_t attempt = 0; attempt < OPTIMISTIC_READ_ATTEMPTS; ++attempt) {
+    uint64_t parent_id;
+    uint64_t parent_version;
+    WalkResult result = walkOptimistically(fde_path, &parent_id, &parent_version, inode_id_ptr);
+    if (result == WalkResult::NOT_FOUND) {
+      return -1;
+    }
+
+    // stat is consistent by itself (see statUnlocked), the entry only has to stay linked meanwhile
+    if (result == WalkResult::FOUND) {
+      *stat_ptr = inodes_.statUnlocked(*inode_id_ptr);
+      if (inodes_.isVersionCurrent(parent_id, parent_version)) {
+        return 0;
+      }
+    }
   }
 
-  if (fde_path[0] != '/') {
+  uint64_t parent_id;
+  std::string_view name;
+  InodeLock parent_lock;
+  if (walkToParent(fde_path, /*create_parents=*/false, /*lock_exclusively=*/false, &parent_id, &name, &parent_lock) <
+      0) {
     return -1;
   }
 
-  if (fde_path[fde_path.size() - 1] == '/') {
+  if (name.empty()) {
+    *inode_id_ptr = 0;
+  } else if (lookupChild(getInodeById(parent_id), name, inode_id_ptr) < 0) {
     return -1;
   }
 
-  const char* next_name_ptr = fde_path.c_str() + 1;
-  const char* next_name_end = strchr(next_name_ptr, '/');
+  // the link can't be removed while the parent is locked, so the entry itself isn't locked
+  *stat_ptr = inodes_.statUnlocked(*inode_id_ptr);
+  return 0;
+}
 
-  uint64_t current_inode_id = 0;
-  while (next_name_end != nullptr) {
-    uint64_t next_name_len = next_name_end - next_name_ptr;
+int FileSystem::readFDE(const std::string& fde_path, void* buffer, uint64_t offset, uint64_t count) {
+  for (uint64_t attempt = 0; attempt < OPTIMISTIC_READ_ATTEMPTS; ++attempt) {
+    uint64_t inode_id;
+    Inode inode_copy;
+    uint64_t version;
+    WalkResult result = copyOptimistically(fde_path, &inode_id, &inode_copy, &version);
+    if (result == WalkResult::NOT_FOUND) {
+      return -1;
+    }
+
+    if (result == WalkResult::FOUND) {
+      int rc = inodes_.readUnlocked(&inode_copy, buffer, offset, count);
+      if (inodes_.isVersionCurrent(inode_id, version)) {
+        return rc;
+      }
+    }
+  }
+
+  uint64_t inode_id;
+  InodeLock lock;
+  if (lookupFDE(fde_path, /*lock_exclusively=*/false, &inode_id, &lock) < 0) {
+    return -1;
+  }
+
+  return read(&getInodeById(inode_id), buffer, offset, count);
+}
+
+FileSystem::WalkResult FileSystem::walkOptimistically(std::string_view fde_path, uint64_t* parent_id_ptr,
+                                                      uint64_t* parent_version_ptr, uint64_t* inode_id_ptr) {
+  if (fde_path.empty() || fde_path[0] != '/') {
+    return WalkResult::NOT_FOUND;
+  }
+
+  std::string_view rest = fde_path.substr(1);
+  uint64_t parent_id = 0;
+  uint64_t parent_version = inodes_.readVersion(0);
+  if (parent_version % 2 != 0) {
+    return WalkResult::RACED;
+  }
+
+  if (rest.empty()) {
+    *parent_id_ptr = 0;
+    *parent_version_ptr = parent_version;
+    *inode_id_ptr = 0;
+    return WalkResult::FOUND;
+  }
+
+  while (true) {
+    size_t name_end = rest.find('/');
+    std::string_view name = rest.substr(0, name_end);
+    if (name.empty()) {
+      return WalkResult::NOT_FOUND;
+    }
+
+    uint64_t child_id;
+    if (WalkResult result = lookupChildOptimistically(parent_id, parent_version, name, &child_id);
+        result != WalkResult::FOUND) {
+      return result;
+    }
 
-    char* name = new char[next_name_len + 1];
+    if (name_end == std::string_view::npos) {
+      *parent_id_ptr = parent_id;
+      *parent_version_ptr = parent_version;
+      *inode_id_ptr = child_id;
+      return WalkResult::FOUND;
+    }
+
+    rest.remove_prefix(name_end + 1);
+    if (rest.empty()) {
+      return WalkResult::NOT_FOUND;
+    }
+
+    // version of the child is taken while the link to it is known to be valid, so it's the version of this child
+    uint64_t child_version = inodes_.readVersion(child_id);
+    bool is_dir = inodes_.statUnlocked(child_id).is_dir;
+    if (!inodes_.isVersionCurrent(parent_id, parent_version) || child_version % 2 != 0) {
+      return WalkResult::RACED;
+    }
+
+    if (!is_dir) {
+      return WalkResult::NOT_FOUND;
+    }
+
+    parent_id = child_id;
+    parent_version = child_version;
+  }
+}
+
+FileSystem::WalkResult FileSystem::copyOptimistically(std::string_view fde_path, uint64_t* inode_id_ptr,
+                                                      Inode* inode_copy_ptr, uint64_t* version_ptr) {
+  uint64_t parent_id;
+  uint64_t parent_version;
+  if (WalkResult result = walkOptimistically(fde_path, &parent_id, &parent_version, inode_id_ptr);
+      result != WalkResult::FOUND) {
+    return result;
+  }
 
-    memcpy(name, next_name_ptr, next_name_len);
-    name[next_name_len] = 0;
+  *version_ptr = inodes_.readVersion(*inode_id_ptr);
+  if (!inodes_.isVersionCurrent(parent_id, parent_version) || *version_ptr % 2 != 0) {
+    return WalkResult::RACED;
+  }
+
+  inodes_.copyInode(*inode_id_ptr, inode_copy_ptr);
+  return WalkResult::FOUND;
+}
 
-    uint64_t child_id = 0;
-    if (getChildId(inodes_.getInodeById(current_inode_id), std::string(name), &child_id) < 0) {
-      delete[] name;
+FileSystem::WalkResult FileSystem::lookupChildOptimistically(uint64_t parent_id, uint64_t parent_version,
+                                                             std::string_view name, uint64_t* child_id_ptr) {
+  switch (dentry_cache_.lookup(parent_id, name, child_id_ptr)) {
+    case DentryCache::LookupResult::FOUND:
+      return WalkResult::FOUND;
+    case DentryCache::LookupResult::NOT_FOUND:
+      // the id may already belong to another directory
+      return inodes_.isVersionCurrent(parent_id, parent_version) ? WalkResult::NOT_FOUND : WalkResult::RACED;
+    case DentryCache::LookupResult::MISS:
+      break;
+  }
+
+  Inode parent_copy;
+  inodes_.copyInode(parent_id, &parent_copy);
+
+  Link link;
+  int rc = parent_copy.is_dir ? inodes_.findDirectoryEntryUnlocked(&parent_copy, name, &link) : -1;
+  if (!inodes_.isVersionCurrent(parent_id, parent_version)) {
+    return WalkResult::RACED;
+  }
+
+  if (rc < 0) {
+    dentry_cache_.insertNegative(parent_id, name, inodes_.getVersion(parent_id), parent_version);
+    return WalkResult::NOT_FOUND;
+  }
+
+  dentry_cache_.insert(parent_id, name, link.inode_id, inodes_.getVersion(parent_id), parent_version);
+  *child_id_ptr = link.inode_id;
+  return WalkResult::FOUND;
+}
+
+int FileSystem::walkToParent(std::string_view fde_path, bool create_parents, bool lock_exclusively,
+                             uint64_t* parent_id_ptr, std::string_view* name_ptr, InodeLock* parent_lock_ptr) {
+  if (fde_path.empty() || fde_path[0] != '/') {
+    return -1;
+  }
+
+  *parent_id_ptr = 0;
+  *name_ptr = {};
+  std::string_view rest = fde_path.substr(1);
+  uint64_t current_inode_id = 0;
+  InodeLock current_lock = inodes_.lockInode(0, lock_exclusively && rest.find('/') == std::string_view::npos);
+  if (rest.empty()) {
+    *parent_lock_ptr = std::move(current_lock);
+    return 0;
+  }
+
+  for (size_t name_end = rest.find('/'); name_end != std::string_view::npos; name_end = rest.find('/')) {
+    std::string_view name = rest.substr(0, name_end);
+    rest.remove_prefix(name_end + 1);
+    if (name.empty()) {
       return -1;
     }
 
-    delete[] name;
+    uint64_t child_id;
+    if (lookupChild(getInodeById(current_inode_id), name, &child_id) < 0) {
+      if (!create_parents || lookupOrCreateDir(current_inode_id, name, &current_lock, &child_id) < 0) {
+        return -1;
+      }
+    }
 
+    // the child is locked before its parent is released, so it can't be unlinked and reclaimed in between
+    InodeLock child_lock = inodes_.lockInode(child_id, lock_exclusively && rest.find('/') == std::string_view::npos);
     if (!getInodeById(child_id).is_dir) {
       return -1;
     }
 
     current_inode_id = child_id;
-    next_name_ptr = next_name_end + 1;
-    next_name_end = strchr(next_name_ptr, '/');
+    current_lock = std::move(child_lock);
   }
 
-  uint64_t child_id = 0;
-  if (getChildId(inodes_.getInodeById(current_inode_id), std::string(next_name_ptr), &child_id) < 0) {
+  if (rest.empty()) {
     return -1;
   }
 
-  *result_ptr = child_id;
+  *parent_id_ptr = current_inode_id;
+  *name_ptr = rest;
+  *parent_lock_ptr = std::move(current_lock);
   return 0;
 }
 
-bool FileSystem::existsChild(internal::Inode& parent_inode, const std::string& name) {
-  for (uint64_t i = 0; i * sizeof(Link) < parent_inode.file_size; ++i) {
-    Link link;
-    inodes_.read(&parent_inode, &link, i * sizeof(Link), sizeof(Link));
-    if (strcmp(link.name, name.c_str()) == 0 && link.is_alive) {
-      return true;
+int FileSystem::lookupOrCreateDir(uint64_t parent_id, std::string_view name, InodeLock* parent_lock_ptr,
+                                  uint64_t* child_id_ptr) {
+  if (!parent_lock_ptr->isExclusive()) {
+    // shared lock can't be upgraded in place, the pin keeps the directory from being reclaimed while it's released
+    reclaimer_.pin(parent_id);
+    parent_lock_ptr->unlock();
+    *parent_lock_ptr = inodes_.lockInode(parent_id, /*is_exclusive=*/true);
+    reclaimer_.unpin(parent_id);
+
+    // the directory could be deleted while it wasn't locked
+    if (reclaimer_.isOrphan(parent_id)) {
+      return -1;
+    }
+
+    if (lookupChild(getInodeById(parent_id), name, child_id_ptr) >= 0) {
+      return 0;
     }
   }
-  return false;
+
+  return createChild(getInodeById(parent_id), name, /*is_dir=*/true, child_id_ptr);
 }
 
-int FileSystem::getChildId(internal::Inode& parent_inode, const std::string& name, uint64_t* result_ptr) {
-  for (uint64_t i = 0; i * sizeof(Link) < parent_inode.file_size; ++i) {
-    Link link;
-    inodes_.read(&parent_inode, &link, i * sizeof(Link), sizeof(Link));
-    if (strcmp(link.name, name.c_str()) == 0 && link.is_alive) {
-      *result_ptr = link.inode_id;
+int FileSystem::lookupChild(Inode& parent_inode, std::string_view name, uint64_t* child_id_ptr) {
+  uint64_t parent_id = inodes_.getInodeId(&parent_inode);
+  switch (dentry_cache_.lookup(parent_id, name, child_id_ptr)) {
+    case DentryCache::LookupResult::FOUND:
       return 0;
-    }
+    case DentryCache::LookupResult::NOT_FOUND:
+      return -1;
+    case DentryCache::LookupResult::MISS:
+      break;
+  }
+
+  Link link;
+  if (inodes_.findDirectoryEntry(&parent_inode, name, &link, nullptr) < 0) {
+    dentry_cache_.insertNegative(parent_id, name);
+    return -1;
   }
 
-  return -1;
+  dentry_cache_.insert(parent_id, name, link.inode_id);
+  *child_id_ptr = link.inode_id;
+  return 0;
 }
 
-int FileSystem::createChild(internal::Inode& parent_inode, const std::string& name, bool is_dir) {
+int FileSystem::createChild(Inode& parent_inode, std::string_view name, bool is_dir, uint64_t* child_id_ptr) {
   if (name.size() > MAX_LINK_NAME_LEN) {
     return -1;
   }
 
-  if (existsChild(parent_inode, name)) {
-    return -1;
+  uint64_t parent_id = inodes_.getInodeId(&parent_inode);
+  if (inodes_.addDirectoryEntry(&parent_inode, name, is_dir, child_id_ptr) < 0) {
+    reclaimer_.waitForIdle();
+    if (inodes_.addDirectoryEntry(&parent_inode, name, is_dir, child_id_ptr) < 0) {
+      return -1;
+    }
   }
 
-  if (inodes_.addDirectoryEntry(&parent_inode, name.c_str(), is_dir) < 0) {
-    return -1;
+  if (is_dir) {
+    // entries of a deleted directory with the same id may still be cached
+    dentry_cache_.forgetDirectory(*child_id_ptr);
   }
+  dentry_cache_.insert(parent_id, name, *child_id_ptr);
 
 #ifdef REDUNDANT_CHECKS
-  uint64_t child_id;
-  int rc = getChildId(parent_inode, name, &child_id);
-  assert(rc >= 0);
+  Link link;
+  int rc = inodes_.findDirectoryEntry(&parent_inode, name, &link, nullptr);
+  assert(rc >= 0 && link.inode_id == *child_id_ptr);
   FSC_USED_BY_ASSERT(rc);
 #endif
 
@@ -242,185 +510,476 @@ int FileSystem::read(Inode* inode_ptr, void* buffer, uint64_t offset, uint64_t c
   return inodes_.read(inode_ptr, buffer, offset, count);
 }
 
+int FileSystem::mapRange(Inode* inode_ptr, uint64_t offset, uint64_t count, std::vector<iovec>* ranges) const {
+  return inodes_.mapRange(inode_ptr, offset, count, ranges);
+}
+
 int FileSystem::write(Inode* inode_ptr, const void* buffer, uint64_t offset, uint64_t count) {
-  return inodes_.write(inode_ptr, buffer, offset, count);
+  if (Inodes::growFreesData(*inode_ptr, offset + count) && moveMappedData(inode_ptr, inode_ptr->file_size) < 0) {
+    return -1;
+  }
+
+  int rc = inodes_.write(inode_ptr, buffer, offset, count);
+  // space may be held by deleted files that aren't reclaimed yet, the reclaimer may also finish right after the
+  // failure, so the retry doesn't depend on whether there was anything to wait for
+  if (rc < 0) {
+    reclaimer_.waitForIdle();
+    rc = inodes_.write(inode_ptr, buffer, offset, count);
+  }
+
+  return rc;
 }
 
 [[maybe_unused]] int FileSystem::append(Inode* inode_ptr, const void* buffer, uint64_t count) {
   return inodes_.append(inode_ptr, buffer, count);
 }
 
-Inode& FileSystem::getInodeById(uint64_t inode_id) {
-  return inodes_.getInodeById(inode_id);
+int FileSystem::reserve(Inode* inode_ptr, uint64_t size) {
+  if (Inodes::growFreesData(*inode_ptr, size) && moveMappedData(inode_ptr, inode_ptr->file_size) < 0) {
+    return -1;
+  }
+
+  int rc = inodes_.reserve(inode_ptr, size);
+  if (rc < 0) {
+    reclaimer_.waitForIdle();
+    rc = inodes_.reserve(inode_ptr, size);
+  }
+
+  return rc;
 }
 
-int FileSystem::createFDE(const std::string& fde_path, bool is_dir) {
-  if (existsFDE(fde_path)) {
+int FileSystem::truncate(Inode* inode_ptr, uint64_t new_size) {
+  if (Inodes::truncateFreesData(*inode_ptr, new_size) &&
+      moveMappedData(inode_ptr, std::min(new_size, inode_ptr->file_size)) < 0) {
     return -1;
   }
 
-  if (fde_path[0] != '/') {
-    return -1;
+  return inodes_.truncate(inode_ptr, new_size);
+}
+
+void FileSystem::mapInode(uint64_t inode_id) {
+  reclaimer_.map(inode_id);
+}
+
+void FileSystem::unmapInode(uint64_t inode_id) {
+  reclaimer_.unmap(inode_id);
+}
+
+int FileSystem::moveMappedData(Inode* inode_ptr, uint64_t keep_size) {
+  const uint64_t inode_id = inodes_.getInodeId(inode_ptr);
+  if (!reclaimer_.isMapped(inode_id)) {
+    return 0;
   }
 
-  if (fde_path[fde_path.size() - 1] == '/') {
+  uint64_t holder_id;
+  if (inodes_.createInode(inode_id, /*is_dir=*/false, &holder_id) < 0) {
     return -1;
   }
 
-  const char* next_name_ptr = fde_path.c_str() + 1;
-  const char* next_name_end = strchr(next_name_ptr, '/');
+  // holder is an orphan from the start, so its blocks are reclaimed on mount if the process crashes meanwhile
+  reclaimer_.pin(holder_id);
+  reclaimer_.addOrphan(holder_id);
 
-  uint64_t current_inode_id = 0;
-  while (next_name_end != nullptr) {
-    uint64_t next_name_len = next_name_end - next_name_ptr;
+  Inode& holder = getInodeById(holder_id);
+  inodes_.moveData(inode_ptr, &holder);
 
-    char* name = new char[next_name_len + 1];
+  // space may be held by deleted files like in write, the part copied by the first attempt is written over
+  int rc = inodes_.copyData(&holder, inode_ptr, keep_size);
+  if (rc < 0) {
+    reclaimer_.waitForIdle();
+    rc = inodes_.copyData(&holder, inode_ptr, keep_size);
+  }
 
-    memcpy(name, next_name_ptr, next_name_len);
-    name[next_name_len] = 0;
+  if (rc < 0) {
+    // the copy was never mapped, so it's freed at once
+    inodes_.moveData(&holder, inode_ptr);
+    reclaimer_.unpin(holder_id);
+    return -1;
+  }
 
-    uint64_t child_id = 0;
-    Inode& current_inode = inodes_.getInodeById(current_inode_id);
-    if (!existsChild(current_inode, name)) {
-      if (createChild(current_inode, name, true) < 0) {
-        delete[] name;
-        return -1;
-      }
-    }
+  reclaimer_.holdUntilUnmapped(inode_id, holder_id);
+  return 0;
+}
 
-    if (getChildId(current_inode, std::string(name), &child_id) < 0) {
-      delete[] name;
-      return -1;
-    }
+int FileSystem::seekData(Inode* inode_ptr, uint64_t offset, uint64_t* result_ptr) {
+  return inodes_.seekData(inode_ptr, offset, result_ptr);
+}
 
-    delete[] name;
+int FileSystem::seekHole(Inode* inode_ptr, uint64_t offset, uint64_t* result_ptr) {
+  return inodes_.seekHole(inode_ptr, offset, result_ptr);
+}
 
-    if (!getInodeById(child_id).is_dir) {
-      return -1;
-    }
+Inode& FileSystem::getInodeById(uint64_t inode_id) {
+  return inodes_.getInodeById(inode_id);
+}
 
-    current_inode_id = child_id;
-    next_name_ptr = next_name_end + 1;
-    next_name_end = strchr(next_name_ptr, '/');
+InodeLock FileSystem::lockInode(uint64_t inode_id, bool lock_exclusively) {
+  return inodes_.lockInode(inode_id, lock_exclusively);
+}
+
+InodeStat FileSystem::statInode(uint64_t inode_id) const {
+  return inodes_.statUnlocked(inode_id);
+}
+
+int FileSystem::createFDE(const std::string& fde_path, bool is_dir, bool fail_if_exists, uint64_t* inode_id_ptr,
+                          InodeLock* lock_ptr, bool* created_ptr) {
+  uint64_t parent_id;
+  std::string_view name;
+  InodeLock parent_lock;
+  if (walkToParent(fde_path, /*create_parents=*/true, /*lock_exclusively=*/true, &parent_id, &name, &parent_lock) <
+          0 ||
+      name.empty()) {
+    return -1;
   }
 
-  Inode& current_inode = getInodeById(current_inode_id);
-  if (!existsChild(current_inode, next_name_ptr)) {
-    if (createChild(current_inode, next_name_ptr, is_dir) < 0) {
+  Inode& parent_inode = getInodeById(parent_id);
+  uint64_t child_id;
+  bool created = false;
+  if (lookupChild(parent_inode, name, &child_id) >= 0) {
+    if (fail_if_exists || getInodeById(child_id).is_dir != is_dir) {
       return -1;
     }
+  } else if (createChild(parent_inode, name, is_dir, &child_id) < 0) {
+    return -1;
+  } else {
+    created = true;
   }
 
+  if (inode_id_ptr != nullptr) {
+    *inode_id_ptr = child_id;
+  }
+  if (lock_ptr != nullptr) {
+    *lock_ptr = inodes_.lockInode(child_id, /*is_exclusive=*/false);
+  }
+  if (created_ptr != nullptr) {
+    *created_ptr = created;
+  }
   return 0;
 }
 
 bool FileSystem::existsFDE(const std::string& fde_path) {
   uint64_t inode_id;
-  return getFDEInodeId(fde_path, &inode_id) >= 0;
+  InodeStat stat;
+  return statFDE(fde_path, &inode_id, &stat) >= 0;
 }
 
 int FileSystem::deleteFDE(const std::string& fde_path, bool is_dir) {
-  if (fde_path == "/") {
+  uint64_t parent_id;
+  std::string_view name;
+  InodeLock parent_lock;
+  if (walkToParent(fde_path, /*create_parents=*/false, /*lock_exclusively=*/true, &parent_id, &name, &parent_lock) <
+          0 ||
+      name.empty()) {
     return -1;
   }
 
-  uint64_t inode_id;
-  if (getFDEInodeId(fde_path, &inode_id) < 0 || getInodeById(inode_id).is_dir != is_dir) {
+  Inode& parent_inode = getInodeById(parent_id);
+  Link link;
+  uint64_t link_index;
+  if (inodes_.findDirectoryEntry(&parent_inode, name, &link, &link_index) < 0 || link.is_dir != is_dir) {
     return -1;
   }
 
-  if (deleteInode(inode_id) < 0) {
-    return -1;
+  // entries of directories in the subtree are forgotten when they are reclaimed
+  dentry_cache_.invalidate(parent_id, name);
+  if (is_dir) {
+    dentry_cache_.forgetDirectory(link.inode_id);
   }
 
-  uint64_t parent_inode_id;
-  int rc = getFDEInodeParentId(fde_path, &parent_inode_id);
-  assert(rc >= 0);
-  FSC_USED_BY_ASSERT(rc);
+  // the inode is orphaned before it's unlinked, so a crash in between doesn't leak it, the record lets the next mount
+  // remove the link
+  std::lock_guard unlink_guard(unlink_mutex_);
+  super_block_ptr_->pending_unlink = {
+      .parent_id = parent_id + 1, .link_index = link_index, .link = link, .orphan_id = link.inode_id + 1};
 
-  Inode& parent_inode = getInodeById(parent_inode_id);
-  for (uint64_t i = 0; i * sizeof(Link) < parent_inode.file_size; ++i) {
-    Link link;
-    read(&parent_inode, &link, i * sizeof(Link), sizeof(Link));
-    if (link.inode_id == inode_id) {
-      assert(link.is_alive);
-      link.is_alive = false;
-      if (write(&parent_inode, &link, i * sizeof(Link), sizeof(Link)) < 0) {
-        return -1;
-      }
+  // blocks of the inode (and the whole subtree of a directory) are freed in the background, the pin keeps the orphan
+  // from being freed while the record points to it
+  reclaimer_.pin(link.inode_id);
+  reclaimer_.addOrphan(link.inode_id);
 
-      break;
-    }
+  // the link is rewritten in place, so this can only fail on corruption
+  if (inodes_.removeDirectoryEntry(&parent_inode, link_index) < 0) {
+    std::abort();
   }
 
+  super_block_ptr_->pending_unlink = {};
+  reclaimer_.unpin(link.inode_id);
   return 0;
 }
 
-int FileSystem::getFDEInodeParentId(std::string fde_path, uint64_t* result_ptr) {
-  if (fde_path == "/") {
-    return -1;
+int FileSystem::renameFDE(const std::string& from_path, const std::string& to_path) {
+  std::lock_guard rename_guard(rename_mutex_);
+
+  // parents are resolved one by one and locked together later, pins keep their ids from reuse in between
+  uint64_t from_parent_id;
+  std::string_view from_name;
+  {
+    InodeLock parent_lock;
+    if (walkToParent(from_path, /*create_parents=*/false, /*lock_exclusively=*/false, &from_parent_id, &from_name,
+                     &parent_lock) < 0 ||
+        from_name.empty()) {
+      return -1;
+    }
+    reclaimer_.pin(from_parent_id);
   }
 
-  if (fde_path[0] != '/') {
+  uint64_t to_parent_id;
+  std::string_view to_name;
+  {
+    InodeLock parent_lock;
+    if (walkToParent(to_path, /*create_parents=*/false, /*lock_exclusively=*/false, &to_parent_id, &to_name,
+                     &parent_lock) < 0 ||
+        to_name.empty() || to_name.size() > MAX_LINK_NAME_LEN) {
+      reclaimer_.unpin(from_parent_id);
+      return -1;
+    }
+    reclaimer_.pin(to_parent_id);
+  }
+
+  int rc = moveLink(from_path, from_parent_id, from_name, to_path, to_parent_id, to_name);
+  reclaimer_.unpin(to_parent_id);
+  reclaimer_.unpin(from_parent_id);
+  return rc;
+}
+
+int FileSystem::moveLink(const std::string& from_path, uint64_t from_parent_id, std::string_view from_name,
+                         const std::string& to_path, uint64_t to_parent_id, std::string_view to_name) {
+  InodeLock from_parent_lock;
+  InodeLock to_parent_lock;
+  if (from_parent_id == to_parent_id) {
+    from_parent_lock = inodes_.lockInode(from_parent_id, /*is_exclusive=*/true);
+  } else {
+    // path walks never hold two directories that aren't parent and child, so only an ancestor has to be locked first
+    std::string_view from_dir = std::string_view(from_path).substr(0, from_path.size() - from_name.size());
+    std::string_view to_dir = std::string_view(to_path).substr(0, to_path.size() - to_name.size());
+    if (from_dir.starts_with(to_dir)) {
+      to_parent_lock = inodes_.lockInode(to_parent_id, /*is_exclusive=*/true);
+      from_parent_lock = inodes_.lockInode(from_parent_id, /*is_exclusive=*/true);
+    } else {
+      from_parent_lock = inodes_.lockInode(from_parent_id, /*is_exclusive=*/true);
+      to_parent_lock = inodes_.lockInode(to_parent_id, /*is_exclusive=*/true);
+    }
+  }
+
+  // parents could be deleted while they weren't locked
+  if (reclaimer_.isOrphan(from_parent_id) || reclaimer_.isOrphan(to_parent_id)) {
     return -1;
   }
 
-  if (fde_path[fde_path.size() - 1] == '/') {
+  Inode& from_parent_inode = getInodeById(from_parent_id);
+  Link link;
+  uint64_t from_link_index;
+  if (inodes_.findDirectoryEntry(&from_parent_inode, from_name, &link, &from_link_index) < 0) {
     return -1;
   }
 
-  const char* next_name_ptr = fde_path.c_str() + 1;
-  const char* next_name_end = strchr(next_name_ptr, '/');
+  if (from_path == to_path) {
+    return 0;
+  }
 
-  uint64_t current_inode_id = 0;
-  while (next_name_end != nullptr) {
-    uint64_t next_name_len = next_name_end - next_name_ptr;
+  // paths have no empty components, so directory can't be moved into its own subtree only when it's a prefix
+  if (link.is_dir && to_path.starts_with(from_path) && to_path[from_path.size()] == '/') {
+    return -1;
+  }
 
-    char* name = new char[next_name_len + 1];
+  Inode& to_parent_inode = getInodeById(to_parent_id);
+  Link replaced_link;
+  uint64_t to_link_index;
+  bool is_replacing = (inodes_.findDirectoryEntry(&to_parent_inode, to_name, &replaced_link, &to_link_index) >= 0);
+  if (is_replacing && (link.is_dir || replaced_link.is_dir)) {
+    return -1;
+  }
 
-    memcpy(name, next_name_ptr, next_name_len);
-    name[next_name_len] = 0;
+  // the move is recorded before the new link is written, so a crash never leaves the inode with both links
+  std::lock_guard unlink_guard(unlink_mutex_);
+  PendingUnlink& pending = super_block_ptr_->pending_unlink;
+  pending = {.parent_id = from_parent_id + 1,
+             .link_index = from_link_index,
+             .link = link,
+             .new_parent_id = to_parent_id + 1,
+             .orphan_id = is_replacing ? replaced_link.inode_id + 1 : 0};
+  memcpy(pending.new_name, to_name.data(), to_name.size());
+  if (is_replacing) {
+    reclaimer_.pin(replaced_link.inode_id);
+  }
+
+  int rc = 0;
+  if (is_replacing) {
+    rc = inodes_.relinkDirectoryEntry(&to_parent_inode, to_link_index, link.inode_id);
+  } else if (inodes_.linkDirectoryEntry(&to_parent_inode, to_name, link.is_dir, link.inode_id) < 0) {
+    reclaimer_.waitForIdle();
+    rc = inodes_.linkDirectoryEntry(&to_parent_inode, to_name, link.is_dir, link.inode_id);
+  }
+
+  if (rc == 0) {
+    // new link never moves others, so _from_link_index_ is still valid even in the same directory
+    dentry_cache_.invalidate(from_parent_id, from_name);
+    dentry_cache_.insert(to_parent_id, to_name, link.inode_id);
+    if (inodes_.removeDirectoryEntry(&from_parent_inode, from_link_index) < 0) {
+      std::abort();
+    }
 
-    uint64_t child_id = 0;
-    if (getChildId(inodes_.getInodeById(current_inode_id), std::string(name), &child_id) < 0) {
-      delete[] name;
-      return -1;
+    if (is_replacing) {
+      reclaimer_.addOrphan(replaced_link.inode_id);
     }
+  }
 
-    delete[] name;
+  pending = {};
+  if (is_replacing) {
+    reclaimer_.unpin(replaced_link.inode_id);
+  }
 
-    if (!getInodeById(child_id).is_dir) {
+  return rc < 0 ? -1 : 0;
+}
+
+void FileSystem::finishPendingUnlink() {
+  PendingUnlink& pending = super_block_ptr_->pending_unlink;
+  if (pending.parent_id == 0) {
+    return;
+  }
+
+  FSC_LOG("FSM", "Finishing interrupted unlink.");
+
+  // the reclaimer may be reclaiming the parents, so their locks are taken like the reclaimer's
+  InodeLock parent_lock = inodes_.lockInode(pending.parent_id - 1, /*is_exclusive=*/true);
+  InodeLock new_parent_lock;
+  if (pending.new_parent_id != 0 && pending.new_parent_id != pending.parent_id) {
+    new_parent_lock = inodes_.lockInode(pending.new_parent_id - 1, /*is_exclusive=*/true);
+  }
+
+  // move is finished only if its new link was written, otherwise it's dropped along with the record
+  Link new_link;
+  uint64_t new_link_index;
+  if (pending.new_parent_id != 0 &&
+      (inodes_.findDirectoryEntry(&getInodeById(pending.new_parent_id - 1), pending.new_name, &new_link,
+                                  &new_link_index) < 0 ||
+       new_link.inode_id != pending.link.inode_id)) {
+    pending = {};
+    return;
+  }
+
+  Inode& parent_inode = getInodeById(pending.parent_id - 1);
+  Link link;
+  if (inodes_.read(&parent_inode, &link, pending.link_index * sizeof(Link), sizeof(Link)) == sizeof(Link) &&
+      link.is_alive && link.inode_id == pending.link.inode_id && strcmp(link.name, pending.link.name) == 0 &&
+      inodes_.removeDirectoryEntry(&parent_inode, pending.link_index) < 0) {
+    std::abort();
+  }
+
+  if (pending.orphan_id != 0 && !reclaimer_.isOrphan(pending.orphan_id - 1)) {
+    reclaimer_.addOrphan(pending.orphan_id - 1);
+  }
+
+  pending = {};
+}
+
+void FileSystem::openInode(uint64_t inode_id) {
+  reclaimer_.pin(inode_id);
+}
+
+void FileSystem::closeInode(uint64_t inode_id) {
+  reclaimer_.unpin(inode_id);
+}
+
+void FileSystem::waitForReclaim() {
+  reclaimer_.waitForIdle();
+}
+
+int FileSystem::compactDir(const std::string& dir_path) {
+  uint64_t inode_id;
+  InodeLock lock;
+  if (lookupFDE(dir_path, /*lock_exclusively=*/true, &inode_id, &lock) < 0 || !getInodeById(inode_id).is_dir) {
+    return -1;
+  }
+
+  return inodes_.compactDirectory(&getInodeById(inode_id));
+}
+
+int FileSystem::listDir(const std::string& dir_path, std::string& output) {
+  output.clear();
+
+  std::vector<Link> links;
+  for (uint64_t cursor = 0; cursor != DIR_END_CURSOR;) {
+    links.clear();
+    if (readDir(dir_path, &cursor, LINKS_IN_BLOCK_COUNT, &links) < 0) {
       return -1;
     }
 
-    current_inode_id = child_id;
-    next_name_ptr = next_name_end + 1;
-    next_name_end = strchr(next_name_ptr, '/');
+    for (const auto& link : links) {
+      output += std::string(link.name) + (link.is_dir ? "/ " : " ");
+    }
   }
 
-  *result_ptr = current_inode_id;
   return 0;
 }
 
-int FileSystem::listDir(const std::string& dir_path, std::string& output) {
+int FileSystem::readDir(const std::string& dir_path, uint64_t* cursor_ptr, uint64_t max_count,
+                        std::vector<Link>* links_ptr) {
+  for (uint64_t attempt = 0; attempt < OPTIMISTIC_READ_ATTEMPTS; ++attempt) {
+    uint64_t inode_id;
+    Inode inode_copy;
+    uint64_t version;
+    WalkResult result = copyOptimistically(dir_path, &inode_id, &inode_copy, &version);
+    if (result == WalkResult::NOT_FOUND) {
+      return -1;
+    }
+
+    if (result == WalkResult::FOUND) {
+      // links are returned only after the whole page is known to be consistent
+      uint64_t cursor = *cursor_ptr;
+      std::vector<Link> links;
+      int rc = inode_copy.is_dir ? readLinks(&inode_copy, /*is_copy=*/true, &cursor, max_count, &links) : -1;
+      if (inodes_.isVersionCurrent(inode_id, version)) {
+        if (rc < 0) {
+          return -1;
+        }
+
+        *cursor_ptr = cursor;
+        links_ptr->insert(links_ptr->end(), links.begin(), links.end());
+        return 0;
+      }
+    }
+  }
+
   uint64_t inode_id;
-  if (getFDEInodeId(dir_path, &inode_id) < 0 || !getInodeById(inode_id).is_dir) {
+  InodeLock lock;
+  if (lookupFDE(dir_path, /*lock_exclusively=*/false, &inode_id, &lock) < 0 || !getInodeById(inode_id).is_dir) {
     return -1;
   }
 
-  internal::Inode& inode = getInodeById(inode_id);
+  return readLinks(&getInodeById(inode_id), /*is_copy=*/false, cursor_ptr, max_count, links_ptr);
+}
 
-  output.clear();
+int FileSystem::readLinks(Inode* inode_ptr, bool is_copy, uint64_t* cursor_ptr, uint64_t max_count,
+                          std::vector<Link>* links_ptr) const {
+  const uint64_t link_count = inode_ptr->file_size / sizeof(Link);
+
+  // links are read in chunks rather than one by one
+  Link chunk[LINKS_IN_BLOCK_COUNT];
+  uint64_t cursor = *cursor_ptr;
+  uint64_t found_count = 0;
+  while (cursor < link_count && found_count < max_count) {
+    uint64_t chunk_count = std::min(LINKS_IN_BLOCK_COUNT, link_count - cursor);
+    if (is_copy) {
+      if (inodes_.readUnlocked(inode_ptr, chunk, cursor * sizeof(Link), chunk_count * sizeof(Link)) < 0) {
+        return -1;
+      }
+    } else {
+      read(inode_ptr, chunk, cursor * sizeof(Link), chunk_count * sizeof(Link));
+    }
 
-  for (uint64_t i = 0; i * sizeof(internal::Link) < inode.file_size; ++i) {
-    internal::Link link;
-    read(&inode, &link, i * sizeof(internal::Link), sizeof(internal::Link));
-    if (link.is_alive) {
-      output += std::string(link.name) + ((getInodeById(link.inode_id).is_dir) ? "/ " : " ");
+    uint64_t i = 0;
+    for (; i < chunk_count && found_count < max_count; ++i) {
+      if (chunk[i].is_alive) {
+        links_ptr->push_back(chunk[i]);
+        ++found_count;
+      }
     }
+    cursor += i;
   }
 
+  *cursor_ptr = (cursor < link_count) ? cursor : DIR_END_CURSOR;
   return 0;
 }
 
-}  // namespace fspp::internal
\ No newline at end of file
+}  // namespace fspp::internal
@@ -1,25 +1,37 @@
 #include "fs++/filesystem_client.h"
 
+#include <utility>
+
 // ffile layout
-// | superblock | inode_bitset | block_bitset | inodes | blocks |
+// | superblock | block group counters | inode group counters | inode_bitset | block_bitset | fragment_bitset |
+// | inodes | blocks |
 
 namespace fspp {
 
 FileSystemClient::FileSystemClient(const std::string& ffile_path) : fs_(ffile_path) {
 }
 
-bool FileSystemClient::existsDir(const std::string& dir_path) {
+int FileSystemClient::stat(const std::string& path, FileStat* stat_ptr) {
   uint64_t inode_id;
-
-  if (fs_.getFDEInodeId(dir_path, &inode_id) < 0) {
-    return false;
+  internal::InodeStat inode_stat;
+  if (fs_.statFDE(path, &inode_id, &inode_stat) < 0) {
+    return -1;
   }
 
-  return fs_.getInodeById(inode_id).is_dir;
+  *stat_ptr = {.is_dir = inode_stat.is_dir,
+               .size = inode_stat.file_size,
+               .inode_id = inode_id,
+               .blocks_count = inode_stat.blocks_count};
+  return 0;
+}
+
+bool FileSystemClient::existsDir(const std::string& dir_path) {
+  FileStat stat_buf;
+  return stat(dir_path, &stat_buf) == 0 && stat_buf.is_dir;
 }
 
 int FileSystemClient::createDir(const std::string& dir_path) {
-  return fs_.createFDE(dir_path, /*is_dir=*/true);
+  return fs_.createFDE(dir_path, /*is_dir=*/true, /*fail_if_exists=*/true, nullptr);
 }
 
 int FileSystemClient::deleteDir(const std::string& dir_path) {
@@ -27,54 +39,247 @@ int FileSystemClient::deleteDir(const std::string& dir_path) {
 }
 
 bool FileSystemClient::existsFile(const std::string& file_path) {
-  uint64_t inode_id;
-
-  if (fs_.getFDEInodeId(file_path, &inode_id) < 0) {
-    return false;
-  }
-
-  return !fs_.getInodeById(inode_id).is_dir;
+  FileStat stat_buf;
+  return stat(file_path, &stat_buf) == 0 && !stat_buf.is_dir;
 }
 
 int FileSystemClient::createFile(const std::string& file_path) {
-  return fs_.createFDE(file_path, /*is_dir=*/false);
+  return createFile(file_path, /*fail_if_exists=*/true);
+}
+
+int FileSystemClient::createFile(const std::string& file_path, bool fail_if_exists) {
+  return fs_.createFDE(file_path, /*is_dir=*/false, fail_if_exists, nullptr);
 }
 
 int FileSystemClient::deleteFile(const std::string& file_path) {
   return fs_.deleteFDE(file_path, /*is_dir=*/false);
 }
 
-int FileSystemClient::readFileContent(const std::string& file_path, uint64_t offset, void* buffer, uint64_t size) {
+int FileSystemClient::rename(const std::string& from_path, const std::string& to_path) {
+  return fs_.renameFDE(from_path, to_path);
+}
+
+void FileSystemClient::waitForReclaim() {
+  fs_.waitForReclaim();
+}
+
+int FileSystemClient::open(const std::string& file_path, FileHandle* handle_ptr) {
+  uint64_t inode_id;
+  internal::InodeLock lock;
+  if (fs_.lookupFDE(file_path, /*lock_exclusively=*/false, &inode_id, &lock) < 0 ||
+      fs_.getInodeById(inode_id).is_dir) {
+    return -1;
+  }
+
+  // the handle pins the inode while it's still locked
+  *handle_ptr = FileHandle(&fs_, inode_id);
+  return 0;
+}
+
+int FileSystemClient::open(const std::string& file_path, FileHandle* handle_ptr, bool create, bool* created_ptr) {
+  if (!create) {
+    if (created_ptr != nullptr) {
+      *created_ptr = false;
+    }
+    return open(file_path, handle_ptr);
+  }
+
   uint64_t inode_id;
-  if (fs_.getFDEInodeId(file_path, &inode_id) < 0) {
+  internal::InodeLock lock;
+  if (fs_.createFDE(file_path, /*is_dir=*/false, /*fail_if_exists=*/false, &inode_id, &lock, created_ptr) < 0) {
     return -1;
   }
 
-  return fs_.read(&fs_.getInodeById(inode_id), buffer, offset, size);
+  *handle_ptr = FileHandle(&fs_, inode_id);
+  return 0;
+}
+
+int FileSystemClient::readFileContent(const std::string& file_path, uint64_t offset, void* buffer, uint64_t size) {
+  return fs_.readFDE(file_path, buffer, offset, size);
 }
 
 int FileSystemClient::writeFileContent(const std::string& file_path, uint64_t offset, const void* buffer,
                                        uint64_t size) {
   uint64_t inode_id;
-  if (fs_.getFDEInodeId(file_path, &inode_id) < 0) {
+  internal::InodeLock lock;
+  if (fs_.lookupFDE(file_path, /*lock_exclusively=*/true, &inode_id, &lock) < 0) {
     return -1;
   }
 
   return fs_.write(&fs_.getInodeById(inode_id), buffer, offset, size);
 }
 
+int FileSystemClient::reserve(const std::string& file_path, uint64_t size) {
+  uint64_t inode_id;
+  internal::InodeLock lock;
+  if (fs_.lookupFDE(file_path, /*lock_exclusively=*/true, &inode_id, &lock) < 0) {
+    return -1;
+  }
+
+  internal::Inode& inode = fs_.getInodeById(inode_id);
+  if (inode.is_dir) {
+    return -1;
+  }
+
+  return fs_.reserve(&inode, size);
+}
+
+int FileSystemClient::truncate(const std::string& file_path, uint64_t new_size) {
+  uint64_t inode_id;
+  internal::InodeLock lock;
+  if (fs_.lookupFDE(file_path, /*lock_exclusively=*/true, &inode_id, &lock) < 0) {
+    return -1;
+  }
+
+  internal::Inode& inode = fs_.getInodeById(inode_id);
+  if (inode.is_dir) {
+    return -1;
+  }
+
+  return fs_.truncate(&inode, new_size);
+}
+
+int FileSystemClient::seekData(const std::string& file_path, uint64_t offset, uint64_t* result_ptr) {
+  uint64_t inode_id;
+  internal::InodeLock lock;
+  if (fs_.lookupFDE(file_path, /*lock_exclusively=*/false, &inode_id, &lock) < 0) {
+    return -1;
+  }
+
+  return fs_.seekData(&fs_.getInodeById(inode_id), offset, result_ptr);
+}
+
+int FileSystemClient::seekHole(const std::string& file_path, uint64_t offset, uint64_t* result_ptr) {
+  uint64_t inode_id;
+  internal::InodeLock lock;
+  if (fs_.lookupFDE(file_path, /*lock_exclusively=*/false, &inode_id, &lock) < 0) {
+    return -1;
+  }
+
+  return fs_.seekHole(&fs_.getInodeById(inode_id), offset, result_ptr);
+}
+
 int FileSystemClient::listDir(const std::string& dir_path, std::string& output) {
   return fs_.listDir(dir_path, output);
 }
 
+int FileSystemClient::readDir(const std::string& dir_path, uint64_t* cursor_ptr, uint64_t max_count,
+                              std::vector<DirEntry>* entries_ptr) {
+  std::vector<internal::Link> links;
+  if (fs_.readDir(dir_path, cursor_ptr, max_count, &links) < 0) {
+    return -1;
+  }
+
+  for (const auto& link : links) {
+    entries_ptr->push_back({.name = link.name, .is_dir = link.is_dir});
+  }
+
+  return 0;
+}
+
+int FileSystemClient::compactDir(const std::string& dir_path) {
+  return fs_.compactDir(dir_path);
+}
+
 uint64_t FileSystemClient::fileSize(const std::string& file_path) {
   uint64_t inode_id;
-  int rc = fs_.getFDEInodeId(file_path, &inode_id);
+  internal::InodeStat inode_stat;
+  int rc = fs_.statFDE(file_path, &inode_id, &inode_stat);
 
   assert(rc >= 0);
   FSC_USED_BY_ASSERT(rc);
 
-  return fs_.getInodeById(inode_id).file_size;
+  return inode_stat.file_size;
+}
+
+FileHandle::FileHandle(internal::FileSystem* fs, uint64_t inode_id) : fs_(fs), inode_id_(inode_id) {
+  // the caller holds lock of the inode, so it can't be reclaimed before it's pinned
+  fs_->openInode(inode_id_);
+}
+
+FileHandle::~FileHandle() {
+  close();
+}
+
+FileHandle::FileHandle(FileHandle&& other) noexcept {
+  *this = std::move(other);
+}
+
+FileHandle& FileHandle::operator=(FileHandle&& other) noexcept {
+  if (this != &other) {
+    close();
+    fs_ = std::exchange(other.fs_, nullptr);
+    inode_id_ = other.inode_id_;
+    is_mapped_ = std::exchange(other.is_mapped_, false);
+  }
+
+  return *this;
+}
+
+int FileHandle::pread(void* buffer, uint64_t size, uint64_t offset) {
+  internal::InodeLock lock = fs_->lockInode(inode_id_, /*lock_exclusively=*/false);
+  return fs_->read(&inode(), buffer, offset, size);
+}
+
+int FileHandle::mapRange(uint64_t offset, uint64_t size, std::vector<iovec>* ranges) {
+  internal::InodeLock lock = fs_->lockInode(inode_id_, /*lock_exclusively=*/false);
+  // content is freed only under exclusive lock, so truncates see the mapping before they free what it points to
+  if (!is_mapped_) {
+    fs_->mapInode(inode_id_);
+    is_mapped_ = true;
+  }
+  return fs_->mapRange(&inode(), offset, size, ranges);
+}
+
+void FileHandle::unmapRanges() {
+  if (is_mapped_) {
+    fs_->unmapInode(inode_id_);
+    is_mapped_ = false;
+  }
+}
+
+int FileHandle::pwrite(const void* buffer, uint64_t size, uint64_t offset) {
+  internal::InodeLock lock = fs_->lockInode(inode_id_, /*lock_exclusively=*/true);
+  return fs_->write(&inode(), buffer, offset, size);
+}
+
+uint64_t FileHandle::size() {
+  // the open inode isn't reclaimed, so its size is read without waiting for writes
+  assert(isOpen());
+  return fs_->statInode(inode_id_).file_size;
+}
+
+int FileHandle::reserve(uint64_t size) {
+  internal::InodeLock lock = fs_->lockInode(inode_id_, /*lock_exclusively=*/true);
+  return fs_->reserve(&inode(), size);
+}
+
+int FileHandle::truncate(uint64_t new_size) {
+  internal::InodeLock lock = fs_->lockInode(inode_id_, /*lock_exclusively=*/true);
+  return fs_->truncate(&inode(), new_size);
+}
+
+int FileHandle::seekData(uint64_t offset, uint64_t* result_ptr) {
+  internal::InodeLock lock = fs_->lockInode(inode_id_, /*lock_exclusively=*/false);
+  return fs_->seekData(&inode(), offset, result_ptr);
+}
+
+int FileHandle::seekHole(uint64_t offset, uint64_t* result_ptr) {
+  internal::InodeLock lock = fs_->lockInode(inode_id_, /*lock_exclusively=*/false);
+  return fs_->seekHole(&inode(), offset, result_ptr);
+}
+
+void FileHandle::close() {
+  if (fs_ != nullptr) {
+    unmapRanges();
+    fs_->closeInode(inode_id_);
+    fs_ = nullptr;
+  }
+}
+
+internal::Inode& FileHandle::inode() {
+  assert(isOpen());
+  return fs_->getInodeById(inode_id_);
 }
 
 }  // namespace fspp
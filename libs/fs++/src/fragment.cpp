@@ -0,0 +1,151 @@
+#include "fs++/internal/fragment.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <utility>
+
+namespace fspp::internal {
+
+Fragments::Fragments(Blocks* blocks, BitSet fragment_blocks)
+    : blocks_(blocks), fragment_blocks_(std::move(fragment_blocks)) {
+}
+
+Fragments::Fragments(Fragments&& other) noexcept {
+  *this = std::move(other);
+}
+
+Fragments& Fragments::operator=(Fragments&& other) noexcept {
+  // mutex isn't moved, fragments are moved only while the filesystem is being set up
+  blocks_ = other.blocks_;
+  fragment_blocks_ = std::move(other.fragment_blocks_);
+  bitmaps_ = std::move(other.bitmaps_);
+  for (uint64_t i = 0; i < FRAGMENTS_IN_BLOCK_COUNT; ++i) {
+    blocks_by_free_run_[i] = std::move(other.blocks_by_free_run_[i]);
+  }
+
+  other.blocks_ = nullptr;
+  return *this;
+}
+
+int Fragments::allocate(uint64_t count, id_t hint, FragmentRun* run_ptr) {
+  assert(count != 0 && count < FRAGMENTS_IN_BLOCK_COUNT);
+
+  std::lock_guard guard(mutex_);
+
+  // best fit: the block with the shortest run that is long enough
+  for (uint64_t run_length = count; run_length < FRAGMENTS_IN_BLOCK_COUNT; ++run_length) {
+    if (blocks_by_free_run_[run_length].empty()) {
+      continue;
+    }
+
+    id_t block_id = *blocks_by_free_run_[run_length].begin();
+    uint64_t bitmap = bitmaps_[block_id];
+
+    uint64_t first = 0;
+    while (runMask({.first = static_cast<uint32_t>(first), .count = static_cast<uint32_t>(count)}) & bitmap) {
+      ++first;
+    }
+    assert(first + count <= FRAGMENTS_IN_BLOCK_COUNT);
+
+    *run_ptr = {.block_id = block_id, .first = static_cast<uint32_t>(first), .count = static_cast<uint32_t>(count)};
+    setBitmap(block_id, bitmap, bitmap | runMask(*run_ptr));
+    return 0;
+  }
+
+  id_t block_id;
+  if (blocks_->createBlock(hint, &block_id) < 0) {
+    return -1;
+  }
+  fragment_blocks_.setBit(block_id);
+
+  *run_ptr = {.block_id = block_id, .first = 0, .count = static_cast<uint32_t>(count)};
+  setBitmap(block_id, 0, runMask(*run_ptr));
+  return 0;
+}
+
+void Fragments::free(const FragmentRun& run) {
+  std::lock_guard guard(mutex_);
+
+  auto it = bitmaps_.find(run.block_id);
+  if (it == bitmaps_.end() || (it->second & runMask(run)) != runMask(run)) {
+    std::abort();
+  }
+
+  uint64_t bitmap = it->second;
+  setBitmap(run.block_id, bitmap, bitmap & ~runMask(run));
+
+  if ((bitmap & ~runMask(run)) == 0) {
+    // the bit is cleared first: a crash in between leaks the block instead of freeing it again after reuse
+    fragment_blocks_.clearBit(run.block_id);
+    if (blocks_->deleteBlock(run.block_id) < 0) {
+      std::abort();
+    }
+  }
+}
+
+void Fragments::markAllocated(const FragmentRun& run) {
+  std::lock_guard guard(mutex_);
+
+  uint64_t bitmap = 0;
+  if (auto it = bitmaps_.find(run.block_id); it != bitmaps_.end()) {
+    bitmap = it->second;
+  }
+
+  setBitmap(run.block_id, bitmap, bitmap | runMask(run));
+}
+
+void Fragments::freeEmptyBlocks() {
+  std::lock_guard guard(mutex_);
+
+  for (id_t block_id = 0; block_id < fragment_blocks_.size(); ++block_id) {
+    if (!fragment_blocks_.getBit(block_id) || bitmaps_.contains(block_id)) {
+      continue;
+    }
+
+    fragment_blocks_.clearBit(block_id);
+    if (blocks_->isAllocated(block_id) && blocks_->deleteBlock(block_id) < 0) {
+      std::abort();
+    }
+  }
+}
+
+uint8_t* Fragments::getBytes(const FragmentRun& run) {
+  return blocks_->getBlockById(run.block_id).bytes + run.first * FRAGMENT_SIZE;
+}
+
+uint64_t Fragments::runMask(const FragmentRun& run) {
+  return ((uint64_t{1} << run.count) - 1) << run.first;
+}
+
+uint64_t Fragments::longestCleanRun(uint64_t bitmap) {
+  uint64_t longest_run = 0;
+  uint64_t current_run = 0;
+  for (uint64_t i = 0; i < FRAGMENTS_IN_BLOCK_COUNT; ++i) {
+    current_run = ((bitmap >> i) & 1) ? 0 : current_run + 1;
+    longest_run = std::max(longest_run, current_run);
+  }
+
+  return longest_run;
+}
+
+void Fragments::setBitmap(id_t block_id, uint64_t old_bitmap, uint64_t new_bitmap) {
+  if (old_bitmap != 0) {
+    uint64_t old_run = longestCleanRun(old_bitmap);
+    if (old_run != 0) {
+      blocks_by_free_run_[old_run].erase(block_id);
+    }
+  }
+
+  if (new_bitmap == 0) {
+    bitmaps_.erase(block_id);
+    return;
+  }
+
+  bitmaps_[block_id] = new_bitmap;
+  if (uint64_t new_run = longestCleanRun(new_bitmap); new_run != 0) {
+    blocks_by_free_run_[new_run].insert(block_id);
+  }
+}
+
+}  // namespace fspp::internal
@@ -0,0 +1,211 @@
+#include "fs++/internal/group.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+
+#include "fs++/internal/compiler.h"
+
+namespace fspp::internal {
+
+AllocationGroups::AllocationGroups(uint64_t element_num, uint64_t group_num, uint8_t* bitset_bytes,
+                                   uint64_t* free_num_ptr, uint64_t* group_free_nums)
+    : group_size_(element_num / group_num), free_num_ptr_(free_num_ptr) {
+  assert(element_num % group_num == 0);
+  assert(group_size_ % 64 == 0);
+
+  for (uint64_t group = 0; group < group_num; ++group) {
+    groups_.emplace_back(group_size_, bitset_bytes + groupStart(group) / 8, &group_free_nums[group]);
+  }
+}
+
+int AllocationGroups::allocate(uint64_t hint, uint64_t* result_ptr) {
+  if (!reserve(1)) {
+    return -1;
+  }
+
+  uint64_t hint_group = (groupOf(hint) < groupNum()) ? groupOf(hint) : 0;
+
+  // reserved id is always in some group, but it can be freed in a group that was already checked
+  for (uint64_t i = 0;; ++i) {
+    uint64_t group_index = (hint_group + i) % groupNum();
+    Group& group = groups_[group_index];
+
+    std::lock_guard guard(group.mutex);
+    if (*group.free_num_ptr == 0) {
+      continue;
+    }
+
+    uint64_t local_id;
+    if (group_index != hint_group || group.bit_set.findCleanBit(hint - groupStart(group_index), &local_id) < 0) {
+      local_id = group.bit_set.findCleanBit();
+    }
+
+    group.bit_set.setBit(local_id);
+    --(*group.free_num_ptr);
+
+    *result_ptr = groupStart(group_index) + local_id;
+    return 0;
+  }
+}
+
+int AllocationGroups::allocateRange(uint64_t count, uint64_t hint, std::vector<IdRange>* created_ranges) {
+  if (count == 0) {
+    return 0;
+  }
+
+  if (!reserve(count)) {
+    return -1;
+  }
+
+  if (groupOf(hint) >= groupNum()) {
+    hint = 0;
+  }
+
+  uint64_t hint_group = groupOf(hint);
+
+  // single run that fits everything
+  for (uint64_t i = 0; i < groupNum(); ++i) {
+    uint64_t group_index = (hint_group + i) % groupNum();
+    Group& group = groups_[group_index];
+
+    std::lock_guard guard(group.mutex);
+    if (*group.free_num_ptr < count) {
+      continue;
+    }
+
+    uint64_t run_start;
+    uint64_t search_from = (group_index == hint_group) ? hint - groupStart(group_index) : 0;
+    if (group.bit_set.findCleanRun(search_from, count, &run_start) == 0 ||
+        group.bit_set.findCleanRun(0, count, &run_start) == 0) {
+      group.bit_set.setRange(run_start, count);
+      *group.free_num_ptr -= count;
+
+      created_ranges->push_back({.start = groupStart(group_index) + run_start, .length = count});
+      return 0;
+    }
+  }
+
+  // no single run is big enough: fill holes in next-fit order
+  uint64_t ids_left = count;
+  for (uint64_t i = 0; ids_left != 0; ++i) {
+    uint64_t group_index = (hint_group + i) % groupNum();
+    Group& group = groups_[group_index];
+
+    std::lock_guard guard(group.mutex);
+    uint64_t search_from = (i == 0) ? hint - groupStart(group_index) : 0;
+    while (ids_left != 0 && *group.free_num_ptr != 0) {
+      uint64_t run_start;
+      if (group.bit_set.findCleanBit(search_from, &run_start) < 0) {
+        int rc = group.bit_set.findCleanBit(0, &run_start);
+        assert(rc == 0);
+        FSC_USED_BY_ASSERT(rc);
+      }
+
+      uint64_t run_len = group.bit_set.cleanRunLength(run_start, ids_left);
+      group.bit_set.setRange(run_start, run_len);
+      *group.free_num_ptr -= run_len;
+
+      // runs in neighbouring groups may continue each other
+      if (!created_ranges->empty() &&
+          created_ranges->back().start + created_ranges->back().length == groupStart(group_index) + run_start) {
+        created_ranges->back().length += run_len;
+      } else {
+        created_ranges->push_back({.start = groupStart(group_index) + run_start, .length = run_len});
+      }
+
+      ids_left -= run_len;
+      search_from = run_start + run_len;
+    }
+  }
+
+  return 0;
+}
+
+int AllocationGroups::free(uint64_t id) {
+  Group& group = groups_[groupOf(id)];
+  uint64_t local_id = id - groupStart(groupOf(id));
+
+  {
+    std::lock_guard guard(group.mutex);
+    if (!group.bit_set.getBit(local_id)) {
+      return -1;
+    }
+
+    group.bit_set.clearBit(local_id);
+    ++(*group.free_num_ptr);
+  }
+
+  std::atomic_ref(*free_num_ptr_).fetch_add(1);
+  return 0;
+}
+
+int AllocationGroups::freeRange(const IdRange& range) {
+  uint64_t freed_num = 0;
+  int rc = 0;
+
+  for (uint64_t id = range.start; id < range.start + range.length;) {
+    uint64_t group_index = groupOf(id);
+    uint64_t local_id = id - groupStart(group_index);
+    uint64_t length = std::min(group_size_ - local_id, range.start + range.length - id);
+
+    Group& group = groups_[group_index];
+    std::lock_guard guard(group.mutex);
+    if (group.bit_set.setRunLength(local_id, length) != length) {
+      rc = -1;
+      break;
+    }
+
+    group.bit_set.clearRange(local_id, length);
+    *group.free_num_ptr += length;
+
+    freed_num += length;
+    id += length;
+  }
+
+  std::atomic_ref(*free_num_ptr_).fetch_add(freed_num);
+  return rc;
+}
+
+bool AllocationGroups::isAllocated(uint64_t id) {
+  Group& group = groups_[groupOf(id)];
+
+  std::lock_guard guard(group.mutex);
+  return group.bit_set.getBit(id - groupStart(groupOf(id)));
+}
+
+uint64_t AllocationGroups::getFreeNum() const {
+  return std::atomic_ref(*free_num_ptr_).load();
+}
+
+uint64_t AllocationGroups::findEmptiestGroup() {
+  uint64_t emptiest_group = 0;
+  uint64_t max_free_num = 0;
+
+  for (uint64_t group_index = 0; group_index < groupNum(); ++group_index) {
+    Group& group = groups_[group_index];
+
+    std::lock_guard guard(group.mutex);
+    if (*group.free_num_ptr > max_free_num) {
+      emptiest_group = group_index;
+      max_free_num = *group.free_num_ptr;
+    }
+  }
+
+  return emptiest_group;
+}
+
+bool AllocationGroups::reserve(uint64_t count) {
+  std::atomic_ref free_num(*free_num_ptr_);
+
+  uint64_t current = free_num.load();
+  do {
+    if (current < count) {
+      return false;
+    }
+  } while (!free_num.compare_exchange_weak(current, current - count));
+
+  return true;
+}
+
+}  // namespace fspp::internal
@@ -1,78 +1,650 @@
 #include <fs++/internal/ilist.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
 namespace fspp::internal {
 
-#ifdef NORMAL_ILIST
 id_t InodesList::getBlockIdByIndex(Blocks* blocks, uint64_t index) {
-  assert(index < size_);
-  if (index < ILIST_ZERO_INDIRECTION) {
-    return block_ids_[index];
+  const Extent& extent = findExtent(blocks, index);
+  return extent.physical_start + (index - extent.logical_start);
+}
+
+id_t InodesList::getRunByIndex(Blocks* blocks, uint64_t index, uint64_t* run_length_ptr, uint32_t* flags_ptr) {
+  if (index >= size_) {
+    *run_length_ptr = max_size() - index;
+    *flags_ptr = EXTENT_HOLE;
+    return 0;
+  }
+
+  Extent* records;
+  uint64_t next_start;
+  uint64_t position = findLeaf(blocks, index, &records, &next_start);
+  const Extent& extent = records[position];
+
+  if (index < extent.logical_start) {
+    *run_length_ptr = extent.logical_start - index;
+    *flags_ptr = EXTENT_HOLE;
+    return 0;
+  }
+
+  if (index >= extent.logical_start + extent.length) {
+    *run_length_ptr = next_start - index;
+    *flags_ptr = EXTENT_HOLE;
+    return 0;
+  }
+
+  *run_length_ptr = extent.logical_start + extent.length - index;
+  *flags_ptr = extent.flags;
+  return extent.physical_start + (index - extent.logical_start);
+}
+
+int InodesList::getRunByIndexUnlocked(Blocks* blocks, uint64_t index, id_t* block_id_ptr, uint64_t* run_length_ptr,
+                                      uint32_t* flags_ptr) const {
+  *block_id_ptr = 0;
+  if (index >= size_) {
+    *run_length_ptr = max_size() - index;
+    *flags_ptr = EXTENT_HOLE;
+    return 0;
+  }
+
+  if (root_count_ == 0 || root_count_ > ILIST_ROOT_EXTENT_COUNT || depth_ > ILIST_MAX_DEPTH) {
+    return -1;
+  }
+
+  uint64_t next_start = size_;
+
+  const Extent* records = root_;
+  uint64_t count = root_count_;
+  for (uint64_t depth = depth_; depth > 0; --depth) {
+    uint64_t child = findChild(records, count, index);
+    if (child + 1 < count) {
+      next_start = records[child + 1].logical_start;
+    }
+
+    id_t node_id = records[child].physical_start;
+    if (node_id >= blocks->blockCount()) {
+      return -1;
+    }
+
+    ExtentBlock& node = getNode(blocks, node_id);
+    records = node.records;
+    // count is read once, so the checked value is the one used
+    count = std::atomic_ref<uint64_t>(node.count).load(std::memory_order_relaxed);
+    if (count == 0 || count > EXTENTS_IN_BLOCK_COUNT) {
+      return -1;
+    }
+  }
+
+  uint64_t position = findChild(records, count, index);
+  const Extent extent = records[position];
+
+  if (index < extent.logical_start) {
+    *run_length_ptr = extent.logical_start - index;
+    *flags_ptr = EXTENT_HOLE;
+    return 0;
+  }
+
+  if (index >= extent.logical_start + extent.length) {
+    if (position + 1 < count) {
+      next_start = records[position + 1].logical_start;
+    }
+    if (next_start <= index) {
+      return -1;
+    }
+
+    *run_length_ptr = std::min(next_start, max_size()) - index;
+    *flags_ptr = EXTENT_HOLE;
+    return 0;
+  }
+
+  if (extent.physical_start >= blocks->blockCount() ||
+      extent.length - (index - extent.logical_start) > blocks->blockCount() - extent.physical_start) {
+    return -1;
+  }
+
+  *block_id_ptr = extent.physical_start + (index - extent.logical_start);
+  *run_length_ptr = extent.logical_start + extent.length - index;
+  *flags_ptr = extent.flags;
+  return 0;
+}
+
+int InodesList::freeBlocks(Blocks* blocks) {
+  BlockRange pending = {.start = 0, .length = 0};
+  uint64_t freed_num = 0;
+  int rc = freeSubtree(blocks, root_, root_count_, depth_, &pending, &freed_num);
+  if (freePending(blocks, &pending, {.start = 0, .length = 0}) < 0) {
+    rc = -1;
+  }
+
+  clear();
+  return rc;
+}
+
+int InodesList::truncate(Blocks* blocks, uint64_t index, uint64_t* freed_num_ptr) {
+  *freed_num_ptr = 0;
+  if (index >= size_) {
+    return 0;
   }
 
-  index -= ILIST_ZERO_INDIRECTION;
+  BlockRange pending = {.start = 0, .length = 0};
+  int rc = truncateSubtree(blocks, root_, &root_count_, depth_, index, &pending, freed_num_ptr);
+
+  // shrink the tree while the only child of the root fits in the root
+  while (depth_ > 0 && root_count_ == 1) {
+    id_t node_id = root_[0].physical_start;
+    const ExtentBlock& node = getNode(blocks, node_id);
+    if (node.count > ILIST_ROOT_EXTENT_COUNT) {
+      break;
+    }
 
-  if (index < IDS_IN_BLOCK_COUNT) {
-    return resolveIndirection(blocks, level1_id_, index);
+    memcpy(root_, node.records, node.count * sizeof(Extent));
+    root_count_ = node.count;
+    --depth_;
+
+    if (freePending(blocks, &pending, {.start = node_id, .length = 1}) < 0) {
+      rc = -1;
+    }
   }
 
-  index -= IDS_IN_BLOCK_COUNT;
+  if (freePending(blocks, &pending, {.start = 0, .length = 0}) < 0) {
+    rc = -1;
+  }
 
-  assert(index < IDS_IN_BLOCK_COUNT * IDS_IN_BLOCK_COUNT);
+  if (root_count_ == 0) {
+    clear();
+    return rc;
+  }
 
-  id_t resolved_level1_id = resolveIndirection(blocks, level2_id_, index / IDS_IN_BLOCK_COUNT);
-  index %= IDS_IN_BLOCK_COUNT;
+  // nodes are never left empty, so the last extent is at the end of the rightmost path
+  const Extent* records = root_;
+  uint64_t count = root_count_;
+  for (uint64_t depth = depth_; depth > 0; --depth) {
+    const ExtentBlock& node = getNode(blocks, records[count - 1].physical_start);
+    records = node.records;
+    count = node.count;
+  }
 
-  return resolveIndirection(blocks, resolved_level1_id, index);
+  size_ = records[count - 1].logical_start + records[count - 1].length;
+  return rc;
 }
 
 int InodesList::addBlock(Blocks* blocks, id_t block_id) {
-  if (size_ + 1 == INODE_MAX_BLOCK_COUNT) {
+  return addRange(blocks, size_, {.start = block_id, .length = 1}, /*unwritten=*/false);
+}
+
+int InodesList::addRange(Blocks* blocks, uint64_t index, const BlockRange& range, bool unwritten,
+                         std::vector<id_t>* free_nodes) {
+  if (index > max_size() || range.length > max_size() - index) {
     return -1;
   }
 
-  uint64_t index = size_;
-  ++size_;
+  // allocated ranges never cross the end of the block space
+  assert(range.length <= MAX_EXTENT_LENGTH);
 
-  if (index < ILIST_ZERO_INDIRECTION) {
-    block_ids_[index] = block_id;
-    return 0;
+#ifdef REDUNDANT_CHECKS
+  uint64_t hole_length;
+  uint32_t hole_flags;
+  getRunByIndex(blocks, index, &hole_length, &hole_flags);
+  assert((hole_flags & EXTENT_HOLE) && hole_length >= range.length);
+#endif
+
+  Extent extent = {.logical_start = index,
+                   .physical_start = range.start,
+                   .length = static_cast<uint32_t>(range.length),
+                   .flags = unwritten ? EXTENT_UNWRITTEN : 0};
+  if (free_nodes != nullptr) {
+    insertExtent(blocks, extent, free_nodes);
+  } else if (insertExtent(blocks, extent) < 0) {
+    return -1;
   }
 
-  index -= ILIST_ZERO_INDIRECTION;
+  size_ = std::max(size_, index + range.length);
+  return 0;
+}
 
-  if (index == 0) {
-    if (blocks->createBlock(&level1_id_) < 0) {
-      return -1;
+int InodesList::markWritten(Blocks* blocks, uint64_t index, uint64_t count) {
+  Extent* records;
+  uint64_t next_start;
+  uint64_t* leaf_count_ptr;
+  uint64_t position = findLeaf(blocks, index, &records, &next_start, &leaf_count_ptr);
+  Extent& extent = records[position];
+
+  assert(extent.flags & EXTENT_UNWRITTEN);
+  assert(index + count <= extent.logical_start + extent.length);
+
+  uint64_t offset = index - extent.logical_start;
+  Extent written = {.logical_start = index,
+                    .physical_start = extent.physical_start + offset,
+                    .length = static_cast<uint32_t>(count),
+                    .flags = extent.flags & ~EXTENT_UNWRITTEN};
+  Extent tail = {.logical_start = index + count,
+                 .physical_start = written.physical_start + count,
+                 .length = static_cast<uint32_t>(extent.length - offset - count),
+                 .flags = extent.flags};
+
+  if (offset == 0) {
+    // files are mostly written sequentially: just move the boundary between written and unwritten parts
+    if (position > 0 && tail.length != 0 && canMerge(records[position - 1], written)) {
+      records[position - 1].length += count;
+      extent = tail;
+      return 0;
+    }
+
+    if (tail.length == 0) {
+      // blocks are allocated unwritten right before they are written, so the whole extent is usually written at once
+      // and joins the written neighbours, the first record of the leaf keeps its start, so parents stay valid
+      memmove(&records[position], &records[position + 1], (*leaf_count_ptr - position - 1) * sizeof(Extent));
+      --(*leaf_count_ptr);
+      if (!tryMerge(records, leaf_count_ptr, written)) {
+        insertSorted(records, leaf_count_ptr, written);
+      }
+      return 0;
+    }
+  }
+
+  // nodes for both inserts are allocated up front, so the second one can't fail after the first, the first insert
+  // may add a level to the tree
+  uint64_t nodes_to_insert = countNodesToInsert(blocks, index);
+  if (offset != 0 && tail.length != 0) {
+    nodes_to_insert += depth_ + 2;
+  }
+
+  std::vector<id_t> free_nodes;
+  if (allocateNodes(blocks, nodes_to_insert, extent.physical_start, &free_nodes) < 0) {
+    return -1;
+  }
+
+  if (offset == 0) {
+    extent = written;
+    insertExtent(blocks, tail, &free_nodes);
+  } else {
+    extent.length = offset;
+    insertExtent(blocks, written, &free_nodes);
+    if (tail.length != 0) {
+      insertExtent(blocks, tail, &free_nodes);
+    }
+  }
+
+  // extents were merged on the way, so some nodes weren't needed
+  freeNodes(blocks, free_nodes);
+  return 0;
+}
+
+int InodesList::freeSubtree(Blocks* blocks, const Extent* records, uint64_t count, uint64_t depth,
+                            BlockRange* pending_ptr, uint64_t* freed_num_ptr) {
+  int rc = 0;
+
+  for (uint64_t i = 0; i < count; ++i) {
+    if (depth == 0) {
+      if (freePending(blocks, pending_ptr, {.start = records[i].physical_start, .length = records[i].length}) < 0) {
+        rc = -1;
+      }
+      *freed_num_ptr += records[i].length;
+      continue;
+    }
+
+    const ExtentBlock& child = getNode(blocks, records[i].physical_start);
+    if (freeSubtree(blocks, child.records, child.count, depth - 1, pending_ptr, freed_num_ptr) < 0) {
+      rc = -1;
+    }
+
+    if (freePending(blocks, pending_ptr, {.start = records[i].physical_start, .length = 1}) < 0) {
+      rc = -1;
     }
   }
 
-  if (index < IDS_IN_BLOCK_COUNT) {
-    resolveIndirection(blocks, level1_id_, index) = block_id;
+  return rc;
+}
+
+int InodesList::truncateSubtree(Blocks* blocks, Extent* records, uint64_t* count_ptr, uint64_t depth, uint64_t index,
+                                BlockRange* pending_ptr, uint64_t* freed_num_ptr) {
+  int rc = 0;
+
+  while (*count_ptr != 0) {
+    Extent& record = records[*count_ptr - 1];
+
+    if (depth == 0) {
+      if (record.logical_start >= index) {
+        if (freePending(blocks, pending_ptr, {.start = record.physical_start, .length = record.length}) < 0) {
+          rc = -1;
+        }
+        *freed_num_ptr += record.length;
+        --(*count_ptr);
+        continue;
+      }
+
+      if (record.logical_start + record.length > index) {
+        uint64_t kept_length = index - record.logical_start;
+        uint64_t freed_length = record.length - kept_length;
+        if (freePending(blocks, pending_ptr, {.start = record.physical_start + kept_length, .length = freed_length}) <
+            0) {
+          rc = -1;
+        }
+        *freed_num_ptr += freed_length;
+        record.length = kept_length;
+      }
+
+      break;
+    }
+
+    // key of the first record may be greater than keys of its subtree, so it is always checked record by record
+    ExtentBlock& child = getNode(blocks, record.physical_start);
+    if (*count_ptr > 1 && record.logical_start >= index) {
+      if (freeSubtree(blocks, child.records, child.count, depth - 1, pending_ptr, freed_num_ptr) < 0) {
+        rc = -1;
+      }
+    } else {
+      if (truncateSubtree(blocks, child.records, &child.count, depth - 1, index, pending_ptr, freed_num_ptr) < 0) {
+        rc = -1;
+      }
+
+      if (child.count != 0) {
+        break;
+      }
+    }
+
+    // subtree is empty now
+    if (freePending(blocks, pending_ptr, {.start = record.physical_start, .length = 1}) < 0) {
+      rc = -1;
+    }
+    --(*count_ptr);
+  }
+
+  return rc;
+}
+
+int InodesList::freePending(Blocks* blocks, BlockRange* pending_ptr, const BlockRange& range) {
+  if (pending_ptr->start + pending_ptr->length == range.start) {
+    pending_ptr->length += range.length;
     return 0;
   }
 
-  index -= IDS_IN_BLOCK_COUNT;
+  int rc = 0;
+  if (pending_ptr->length != 0) {
+    rc = blocks->deleteBlocks(*pending_ptr);
+  }
 
-  assert(index < IDS_IN_BLOCK_COUNT * IDS_IN_BLOCK_COUNT);
+  *pending_ptr = range;
+  return rc;
+}
 
-  if (index == 0) {
-    if (blocks->createBlock(&level2_id_) < 0) {
-      return -1;
+uint64_t InodesList::findChild(const Extent* records, uint64_t count, uint64_t logical_index) {
+  assert(count != 0);
+
+  // last record that starts at or before logical_index, the first one covers everything before it
+  uint64_t left = 0;
+  uint64_t right = count;
+  while (right - left > 1) {
+    uint64_t middle = left + (right - left) / 2;
+    if (records[middle].logical_start <= logical_index) {
+      left = middle;
+    } else {
+      right = middle;
     }
   }
 
-  id_t& resolved_level1_id = resolveIndirection(blocks, level2_id_, index / IDS_IN_BLOCK_COUNT);
-  if (index % IDS_IN_BLOCK_COUNT == 0) {
-    if (blocks->createBlock(&resolved_level1_id) < 0) {
-      return -1;
+  return left;
+}
+
+bool InodesList::canMerge(const Extent& left, const Extent& right) {
+  return left.logical_start + left.length == right.logical_start &&
+         left.physical_start + left.length == right.physical_start && left.flags == right.flags &&
+         uint64_t{left.length} + right.length <= MAX_EXTENT_LENGTH;
+}
+
+bool InodesList::tryMerge(Extent* records, uint64_t* count_ptr, const Extent& extent) {
+  uint64_t count = *count_ptr;
+  if (count == 0) {
+    return false;
+  }
+
+  uint64_t prev = findChild(records, count, extent.logical_start);
+  if (records[prev].logical_start > extent.logical_start) {
+    // extent goes before the first record
+    Extent& next = records[0];
+    if (canMerge(extent, next)) {
+      next.logical_start = extent.logical_start;
+      next.physical_start = extent.physical_start;
+      next.length += extent.length;
+      return true;
+    }
+
+    return false;
+  }
+
+  Extent& prev_extent = records[prev];
+  if (canMerge(prev_extent, extent)) {
+    prev_extent.length += extent.length;
+
+    // extent may fill the gap between two records
+    if (prev + 1 < count && canMerge(prev_extent, records[prev + 1])) {
+      prev_extent.length += records[prev + 1].length;
+      memmove(&records[prev + 1], &records[prev + 2], (count - prev - 2) * sizeof(Extent));
+      --(*count_ptr);
+    }
+
+    return true;
+  }
+
+  if (prev + 1 < count && canMerge(extent, records[prev + 1])) {
+    Extent& next = records[prev + 1];
+    next.logical_start = extent.logical_start;
+    next.physical_start = extent.physical_start;
+    next.length += extent.length;
+    return true;
+  }
+
+  return false;
+}
+
+void InodesList::insertSorted(Extent* records, uint64_t* count_ptr, const Extent& record) {
+  uint64_t position = *count_ptr;
+  while (position > 0 && records[position - 1].logical_start > record.logical_start) {
+    --position;
+  }
+
+  memmove(&records[position + 1], &records[position], (*count_ptr - position) * sizeof(Extent));
+  records[position] = record;
+  ++(*count_ptr);
+}
+
+void InodesList::splitNode(Blocks* blocks, ExtentBlock& node, const Extent& pending, std::vector<id_t>* free_nodes,
+                           Extent* sibling_record_ptr) {
+  assert(node.count == EXTENTS_IN_BLOCK_COUNT);
+  assert(!free_nodes->empty());
+
+  id_t sibling_id = free_nodes->back();
+  free_nodes->pop_back();
+
+  ExtentBlock& sibling = getNode(blocks, sibling_id);
+
+  // files mostly grow at the end, so appending to the rightmost node leaves the full node as is
+  uint64_t split_position = node.count / 2;
+  if (pending.logical_start > node.records[node.count - 1].logical_start) {
+    split_position = node.count;
+  }
+
+  sibling.count = node.count - split_position;
+  memcpy(sibling.records, &node.records[split_position], sibling.count * sizeof(Extent));
+  node.count = split_position;
+
+  if (sibling.count == 0 || pending.logical_start >= sibling.records[0].logical_start) {
+    insertSorted(sibling.records, &sibling.count, pending);
+  } else {
+    insertSorted(node.records, &node.count, pending);
+  }
+
+  *sibling_record_ptr = {.logical_start = sibling.records[0].logical_start, .physical_start = sibling_id};
+}
+
+uint64_t InodesList::findLeaf(Blocks* blocks, uint64_t index, Extent** records_ptr, uint64_t* next_start_ptr,
+                              uint64_t** count_ptr_ptr) {
+  assert(index < size_);
+
+  // the closest record to the right on the path bounds the extent that follows the found one
+  uint64_t next_start = size_;
+
+  Extent* records = root_;
+  uint64_t* count_ptr = &root_count_;
+  uint64_t count = root_count_;
+  for (uint64_t depth = depth_; depth > 0; --depth) {
+    uint64_t child = findChild(records, count, index);
+    if (child + 1 < count) {
+      next_start = records[child + 1].logical_start;
     }
+
+    ExtentBlock& node = getNode(blocks, records[child].physical_start);
+    records = node.records;
+    count_ptr = &node.count;
+    count = node.count;
+  }
+
+  uint64_t position = findChild(records, count, index);
+  if (records[position].logical_start > index) {
+    next_start = records[position].logical_start;
+  } else if (position + 1 < count) {
+    next_start = records[position + 1].logical_start;
   }
 
-  index %= IDS_IN_BLOCK_COUNT;
+  *records_ptr = records;
+  *next_start_ptr = next_start;
+  if (count_ptr_ptr != nullptr) {
+    *count_ptr_ptr = count_ptr;
+  }
+  return position;
+}
+
+const Extent& InodesList::findExtent(Blocks* blocks, uint64_t index) {
+  Extent* records;
+  uint64_t next_start;
+  uint64_t position = findLeaf(blocks, index, &records, &next_start);
+  const Extent& extent = records[position];
+
+  assert(extent.logical_start <= index && index < extent.logical_start + extent.length);
+  return extent;
+}
+
+uint64_t InodesList::countNodesToInsert(Blocks* blocks, uint64_t logical_index) {
+  // insertion splits full nodes on the path from the leaf up to the first node that has room
+  uint64_t full_nodes = (root_count_ == ILIST_ROOT_EXTENT_COUNT) ? 1 : 0;
+
+  Extent* records = root_;
+  uint64_t count = root_count_;
+  for (uint64_t depth = depth_; depth > 0; --depth) {
+    ExtentBlock& node = getNode(blocks, records[findChild(records, count, logical_index)].physical_start);
+    records = node.records;
+    count = node.count;
+
+    full_nodes = (count == EXTENTS_IN_BLOCK_COUNT) ? full_nodes + 1 : 0;
+  }
+
+  return full_nodes;
+}
+
+uint64_t InodesList::maxNodesToInsert(uint64_t extent_count) const {
+  return extent_count * (std::min(depth_ + extent_count, ILIST_MAX_DEPTH) + 1);
+}
+
+void InodesList::freeNodes(Blocks* blocks, const std::vector<id_t>& free_nodes) {
+  for (id_t node_id : free_nodes) {
+    if (blocks->deleteBlock(node_id) < 0) {
+      std::abort();
+    }
+  }
+}
+
+int InodesList::allocateNodes(Blocks* blocks, uint64_t count, id_t hint, std::vector<id_t>* free_nodes) {
+  if (count == 0) {
+    return 0;
+  }
+
+  std::vector<BlockRange> node_ranges;
+  if (blocks->createBlocks(count, hint, &node_ranges) < 0) {
+    return -1;
+  }
+
+  for (const auto& range : node_ranges) {
+    for (uint64_t i = 0; i < range.length; ++i) {
+      free_nodes->push_back(range.start + range.length - 1 - i);
+    }
+  }
 
-  resolveIndirection(blocks, resolved_level1_id, index) = block_id;
   return 0;
 }
-#endif
 
-}  // namespace fspp::internal
\ No newline at end of file
+int InodesList::insertExtent(Blocks* blocks, const Extent& extent) {
+  // allocate all nodes that may be needed up front, so the tree is never left half split
+  std::vector<id_t> free_nodes;
+  if (allocateNodes(blocks, countNodesToInsert(blocks, extent.logical_start), extent.physical_start, &free_nodes) <
+      0) {
+    return -1;
+  }
+
+  insertExtent(blocks, extent, &free_nodes);
+
+  // extent was merged on the way, so some nodes weren't needed
+  freeNodes(blocks, free_nodes);
+  return 0;
+}
+
+void InodesList::insertExtent(Blocks* blocks, const Extent& extent, std::vector<id_t>* free_nodes) {
+  bool overflow = false;
+  Extent pending;
+  insertIntoNode(blocks, root_, &root_count_, ILIST_ROOT_EXTENT_COUNT, depth_, extent, free_nodes, &overflow,
+                 &pending);
+
+  if (overflow) {
+    // root is full: move its records to a block and make it the only child of the root
+    assert(!free_nodes->empty());
+    id_t node_id = free_nodes->back();
+    free_nodes->pop_back();
+
+    ExtentBlock& node = getNode(blocks, node_id);
+    node.count = root_count_;
+    memcpy(node.records, root_, root_count_ * sizeof(Extent));
+    insertSorted(node.records, &node.count, pending);
+
+    root_[0] = {.logical_start = 0, .physical_start = node_id};
+    root_count_ = 1;
+    ++depth_;
+  }
+}
+
+void InodesList::insertIntoNode(Blocks* blocks, Extent* records, uint64_t* count_ptr, uint64_t capacity,
+                                uint64_t depth, const Extent& extent, std::vector<id_t>* free_nodes,
+                                bool* overflow_ptr, Extent* pending_ptr) {
+  Extent record;
+
+  if (depth == 0) {
+    if (tryMerge(records, count_ptr, extent)) {
+      return;
+    }
+
+    record = extent;
+  } else {
+    ExtentBlock& child = getNode(blocks, records[findChild(records, *count_ptr, extent.logical_start)].physical_start);
+
+    bool child_overflow = false;
+    Extent child_pending;
+    insertIntoNode(blocks, child.records, &child.count, EXTENTS_IN_BLOCK_COUNT, depth - 1, extent, free_nodes,
+                   &child_overflow, &child_pending);
+
+    if (!child_overflow) {
+      return;
+    }
+
+    splitNode(blocks, child, child_pending, free_nodes, &record);
+  }
+
+  if (*count_ptr == capacity) {
+    *overflow_ptr = true;
+    *pending_ptr = record;
+    return;
+  }
+
+  insertSorted(records, count_ptr, record);
+}
+
+}  // namespace fspp::internal
@@ -1,61 +1,212 @@
 #include <fs++/internal/inode.h>
 
+#include <algorithm>
+#include <bit>
 #include <cstring>
+#include <thread>
+#include <utility>
 
 #include <fs++/internal/logging.h>
 
 namespace fspp::internal {
 
-[[maybe_unused]] Inodes::Inodes(const uint64_t* inode_num_ptr, uint64_t* free_inode_num_ptr, uint8_t* bit_set_bytes,
-                                Blocks* blocks, Inode* inode_bytes)
-    : /*inode_num_ptr_(inode_num_ptr),*/
-      inodes_ptr_start_(inode_bytes),
+InodeLock::InodeLock(InodeSync* sync, bool is_exclusive) : sync_(sync), is_exclusive_(is_exclusive) {
+  if (is_exclusive_) {
+    sync_->mutex.lock();
+    beginChange();
+  } else {
+    sync_->mutex.lock_shared();
+  }
+}
+
+InodeLock::InodeLock(InodeSync* sync, std::try_to_lock_t) : is_exclusive_(true) {
+  if (sync->mutex.try_lock()) {
+    sync_ = sync;
+    beginChange();
+  }
+}
+
+InodeLock::~InodeLock() {
+  unlock();
+}
+
+InodeLock::InodeLock(InodeLock&& other) noexcept {
+  *this = std::move(other);
+}
+
+InodeLock& InodeLock::operator=(InodeLock&& other) noexcept {
+  if (this != &other) {
+    unlock();
+    sync_ = std::exchange(other.sync_, nullptr);
+    is_exclusive_ = other.is_exclusive_;
+  }
+
+  return *this;
+}
+
+void InodeLock::unlock() {
+  if (sync_ == nullptr) {
+    return;
+  }
+
+  if (is_exclusive_) {
+    // changes are published before the version becomes even again
+    sync_->version.fetch_add(1, std::memory_order_release);
+    sync_->mutex.unlock();
+  } else {
+    sync_->mutex.unlock_shared();
+  }
+  sync_ = nullptr;
+}
+
+void InodeLock::beginChange() {
+  // odd version is visible before any change, so readers that copy the inode meanwhile see it changed
+  sync_->version.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+Inodes::Inodes(void* inodes_ptr_start, Blocks* blocks, Fragments* fragments, AllocationGroups inode_groups)
+    : inodes_ptr_start_(static_cast<Inode*>(inodes_ptr_start)),
       blocks_(blocks),
-      free_inode_num_ptr_(free_inode_num_ptr),
-      bit_set_(*inode_num_ptr, bit_set_bytes) {
+      fragments_(fragments),
+      groups_(std::move(inode_groups)),
+      inode_syncs_(std::make_unique<InodeSync[]>(groups_.groupNum() * groups_.groupSize())) {
 }
 
 Inode& Inodes::getInodeById(uint64_t inode_id) {
   return inodes_ptr_start_[inode_id];
 }
 
+uint64_t Inodes::getInodeId(const Inode* inode_ptr) const {
+  return inode_ptr - inodes_ptr_start_;
+}
+
+InodeLock Inodes::lockInode(uint64_t inode_id, bool is_exclusive) {
+  return {&inode_syncs_[inode_id], is_exclusive};
+}
+
+InodeLock Inodes::tryLockInode(uint64_t inode_id) {
+  return {&inode_syncs_[inode_id], std::try_to_lock};
+}
+
+uint64_t Inodes::readVersion(uint64_t inode_id) const {
+  return inode_syncs_[inode_id].version.load(std::memory_order_acquire);
+}
+
+bool Inodes::isVersionCurrent(uint64_t inode_id, uint64_t version) const {
+  // reads of the copied data are done before the version is read again
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return version % 2 == 0 && inode_syncs_[inode_id].version.load(std::memory_order_relaxed) == version;
+}
+
+void Inodes::copyInode(uint64_t inode_id, Inode* inode_copy_ptr) const {
+  memcpy(static_cast<void*>(inode_copy_ptr), &inodes_ptr_start_[inode_id], sizeof(Inode));
+}
+
+InodeStat Inodes::statUnlocked(uint64_t inode_id) const {
+  Inode& inode = inodes_ptr_start_[inode_id];
+  const auto& stat_version = inode_syncs_[inode_id].stat_version;
+
+  while (true) {
+    uint64_t version = stat_version.load(std::memory_order_acquire);
+    if (version % 2 != 0) {
+      // a writer is between the bumps around a single store
+      std::this_thread::yield();
+      continue;
+    }
+
+    InodeStat stat{.is_dir = std::atomic_ref<bool>(inode.is_dir).load(std::memory_order_relaxed),
+                   .file_size = std::atomic_ref<uint64_t>(inode.file_size).load(std::memory_order_relaxed),
+                   .blocks_count = std::atomic_ref<uint64_t>(inode.blocks_count).load(std::memory_order_relaxed)};
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (stat_version.load(std::memory_order_relaxed) == version) {
+      return stat;
+    }
+  }
+}
+
 int Inodes::read(Inode* inode_ptr, void* buffer, uint64_t offset, uint64_t count) const {
   auto& inode = *inode_ptr;
   auto* byte_buffer = static_cast<uint8_t*>(buffer);
-  uint64_t count_down = count;
 
-  uint64_t buffer_offset = 0;
-  uint64_t block_index = offset / BLOCK_SIZE;
+  if (offset >= inode.file_size) {
+    return 0;
+  }
 
-  if (offset % BLOCK_SIZE != 0) {
-    uint64_t block_offset = offset % BLOCK_SIZE;
-    uint64_t start_size = std::min(count_down, BLOCK_SIZE - block_offset);
+  count = std::min(count, inode.file_size - offset);
 
-    auto& block = getBlockByIndex(inode, block_index);
-    memcpy(buffer, block.bytes + block_offset, start_size);
+  if (hasSmallData(inode)) {
+    memcpy(byte_buffer, getSmallData(inode) + offset, count);
+    return count;
+  }
 
-    count_down -= start_size;
-    offset += start_size;
-    buffer_offset += start_size;
+  uint64_t buffer_offset = 0;
+  while (buffer_offset < count) {
+    uint64_t block_offset = offset % BLOCK_SIZE;
+    uint64_t run_length;
+    uint32_t flags;
+    id_t block_id = inode.inodes_list.getRunByIndex(blocks_, offset / BLOCK_SIZE, &run_length, &flags);
+
+    // blocks of the run are contiguous in the ffile, so one memcpy covers the whole run
+    const uint64_t read_size = std::min(count - buffer_offset, run_length * BLOCK_SIZE - block_offset);
+    if (flags & (EXTENT_HOLE | EXTENT_UNWRITTEN)) {
+      memset(byte_buffer + buffer_offset, 0, read_size);
+    } else {
+      memcpy(byte_buffer + buffer_offset, blocks_->getBlockById(block_id).bytes + block_offset, read_size);
+    }
 
-    ++block_index;
+    offset += read_size;
+    buffer_offset += read_size;
   }
 
-  if (buffer_offset == count) {
-    return buffer_offset;
+  return buffer_offset;
+}
+
+int Inodes::readUnlocked(Inode* inode_copy_ptr, void* buffer, uint64_t offset, uint64_t count) const {
+  auto& inode = *inode_copy_ptr;
+  auto* byte_buffer = static_cast<uint8_t*>(buffer);
+
+  if (offset >= inode.file_size) {
+    return 0;
   }
 
-#ifdef REDUNDANT_CHECKS
-  assert(offset % BLOCK_SIZE == 0);
-#endif
+  count = std::min(count, inode.file_size - offset);
+
+  if (hasSmallData(inode)) {
+    if (inode.has_fragment_data) {
+      const FragmentRun& run = getFragmentRun(inode);
+      if (run.block_id >= blocks_->blockCount() || run.first >= FRAGMENTS_IN_BLOCK_COUNT ||
+          run.count > FRAGMENTS_IN_BLOCK_COUNT - run.first) {
+        return -1;
+      }
+    }
 
-  for (; block_index < inode.blocks_count && offset < inode.file_size && buffer_offset < count; ++block_index) {
-    auto& block = getBlockByIndex(inode, block_index);
-    const uint64_t read_size = std::min(count_down, BLOCK_SIZE);
+    if (count > getSmallDataCapacity(inode) || offset > getSmallDataCapacity(inode) - count) {
+      return -1;
+    }
 
-    memcpy(byte_buffer + buffer_offset, block.bytes, read_size);
+    memcpy(byte_buffer, getSmallData(inode) + offset, count);
+    return count;
+  }
+
+  uint64_t buffer_offset = 0;
+  while (buffer_offset < count) {
+    uint64_t block_offset = offset % BLOCK_SIZE;
+    id_t block_id;
+    uint64_t run_length;
+    uint32_t flags;
+    if (inode.inodes_list.getRunByIndexUnlocked(blocks_, offset / BLOCK_SIZE, &block_id, &run_length, &flags) < 0) {
+      return -1;
+    }
+
+    const uint64_t read_size = std::min(count - buffer_offset, run_length * BLOCK_SIZE - block_offset);
+    if (flags & (EXTENT_HOLE | EXTENT_UNWRITTEN)) {
+      memset(byte_buffer + buffer_offset, 0, read_size);
+    } else {
+      memcpy(byte_buffer + buffer_offset, blocks_->getBlockById(block_id).bytes + block_offset, read_size);
+    }
 
-    count_down -= read_size;
     offset += read_size;
     buffer_offset += read_size;
   }
@@ -63,54 +214,110 @@ int Inodes::read(Inode* inode_ptr, void* buffer, uint64_t offset, uint64_t count
   return buffer_offset;
 }
 
-int Inodes::write(Inode* inode_ptr, const void* buffer, uint64_t offset, uint64_t count) {
+int Inodes::mapRange(Inode* inode_ptr, uint64_t offset, uint64_t count, std::vector<iovec>* ranges) const {
+  static const uint8_t ZERO_BYTES[ZERO_RANGE_SIZE]{};
+
   auto& inode = *inode_ptr;
-  const auto* byte_buffer = static_cast<const uint8_t*>(buffer);
-  uint64_t count_down = count;
 
-  if (offset + count > inode.file_size) {
-    if (extend(inode, offset + count) < 0) {
-      FSC_LOG("INODE", "can't extend inodes");
-      return -1;
-    }
+  if (offset >= inode.file_size) {
+    return 0;
   }
 
-#ifdef REDUNDANT_CHECKS
-  assert(offset + count <= inode.file_size);
-#endif
+  count = std::min(count, inode.file_size - offset);
 
-  uint64_t buffer_offset = 0;
-  uint64_t block_index = offset / BLOCK_SIZE;
+  if (hasSmallData(inode)) {
+    ranges->push_back({.iov_base = getSmallData(inode) + offset, .iov_len = count});
+    return count;
+  }
 
-  if (offset % BLOCK_SIZE != 0) {
+  uint64_t mapped_size = 0;
+  while (mapped_size < count) {
     uint64_t block_offset = offset % BLOCK_SIZE;
-    uint64_t start_size = std::min(count_down, BLOCK_SIZE - block_offset);
+    uint64_t run_length;
+    uint32_t flags;
+    id_t block_id = inode.inodes_list.getRunByIndex(blocks_, offset / BLOCK_SIZE, &run_length, &flags);
+
+    uint64_t range_size = std::min(count - mapped_size, run_length * BLOCK_SIZE - block_offset);
+    if (flags & (EXTENT_HOLE | EXTENT_UNWRITTEN)) {
+      range_size = std::min(range_size, ZERO_RANGE_SIZE);
+      ranges->push_back({.iov_base = const_cast<uint8_t*>(ZERO_BYTES), .iov_len = range_size});
+    } else {
+      uint8_t* range_start = blocks_->getBlockById(block_id).bytes + block_offset;
+      // neighbouring extents may be physically contiguous too
+      if (!ranges->empty() && static_cast<uint8_t*>(ranges->back().iov_base) + ranges->back().iov_len == range_start) {
+        ranges->back().iov_len += range_size;
+      } else {
+        ranges->push_back({.iov_base = range_start, .iov_len = range_size});
+      }
+    }
+
+    offset += range_size;
+    mapped_size += range_size;
+  }
+
+  return mapped_size;
+}
+
+int Inodes::write(Inode* inode_ptr, const void* buffer, uint64_t offset, uint64_t count) {
+  auto& inode = *inode_ptr;
+  const auto* byte_buffer = static_cast<const uint8_t*>(buffer);
 
-    auto& block = getBlockByIndex(inode, block_index);
-    memcpy(block.bytes + block_offset, buffer, start_size);
+  if (count == 0) {
+    return 0;
+  }
 
-    count_down -= start_size;
-    offset += start_size;
-    buffer_offset += start_size;
+  if (hasSmallData(inode)) {
+    if (offset + count > getSmallDataCapacity(inode) && growSmallData(inode, offset + count) < 0) {
+      FSC_LOG("INODE", "can't grow small file");
+      return -1;
+    }
+  }
 
-    ++block_index;
+  if (hasSmallData(inode)) {
+    // bytes after the end of file are kept zeroed, so a gap before _offset_ reads as zeros
+    memcpy(getSmallData(inode) + offset, byte_buffer, count);
+    setFileSize(inode, std::max(inode.file_size, offset + count));
+    return count;
   }
 
-  if (buffer_offset == count) {
-    return buffer_offset;
+  // only the written range gets blocks, everything else before the new end of file stays a hole
+  if (allocateBlocks(inode, offset / BLOCK_SIZE, (offset + count + BLOCK_SIZE - 1) / BLOCK_SIZE) < 0) {
+    FSC_LOG("INODE", "can't allocate blocks");
+    return -1;
   }
 
+  setFileSize(inode, std::max(inode.file_size, offset + count));
+
+  uint64_t buffer_offset = 0;
+  while (buffer_offset < count) {
+    uint64_t block_index = offset / BLOCK_SIZE;
+    uint64_t block_offset = offset % BLOCK_SIZE;
+    uint64_t run_length;
+    uint32_t flags;
+    id_t block_id = inode.inodes_list.getRunByIndex(blocks_, block_index, &run_length, &flags);
+
 #ifdef REDUNDANT_CHECKS
-  assert(offset % BLOCK_SIZE == 0);
+    assert(!(flags & EXTENT_HOLE));
 #endif
 
-  for (; block_index < inode.blocks_count && offset < inode.file_size && buffer_offset < count; ++block_index) {
-    auto& block = getBlockByIndex(inode, block_index);
-    const uint64_t write_size = std::min(count_down, BLOCK_SIZE);
+    const uint64_t write_size = std::min(count - buffer_offset, run_length * BLOCK_SIZE - block_offset);
+    uint8_t* run_bytes = blocks_->getBlockById(block_id).bytes;
+
+    if (flags & EXTENT_UNWRITTEN) {
+      // untouched parts of the first and the last written blocks should still read as zeros
+      uint64_t write_end = block_offset + write_size;
+      uint64_t written_block_count = (write_end + BLOCK_SIZE - 1) / BLOCK_SIZE;
+      memset(run_bytes, 0, block_offset);
+      memset(run_bytes + write_end, 0, written_block_count * BLOCK_SIZE - write_end);
+
+      if (inode.inodes_list.markWritten(blocks_, block_index, written_block_count) < 0) {
+        FSC_LOG("INODE", "can't mark blocks as written");
+        return -1;
+      }
+    }
 
-    memcpy(block.bytes, byte_buffer + buffer_offset, write_size);
+    memcpy(run_bytes + block_offset, byte_buffer + buffer_offset, write_size);
 
-    count_down -= write_size;
     offset += write_size;
     buffer_offset += write_size;
   }
@@ -122,20 +329,163 @@ int Inodes::append(Inode* inode_ptr, const void* buffer, uint64_t count) {
   return write(inode_ptr, buffer, inode_ptr->file_size, count);
 }
 
-uint64_t Inodes::createInode() {
-  assert(*free_inode_num_ptr_ != 0);
-  --(*free_inode_num_ptr_);
+int Inodes::reserve(Inode* inode_ptr, uint64_t size) {
+  auto& inode = *inode_ptr;
+
+  if (hasSmallData(inode)) {
+    if (size <= getSmallDataCapacity(inode)) {
+      return 0;
+    }
+
+    if (growSmallData(inode, size) < 0) {
+      return -1;
+    }
+
+    if (hasSmallData(inode)) {
+      return 0;
+    }
+  }
+
+  return allocateBlocks(inode, 0, (size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+}
+
+int Inodes::truncate(Inode* inode_ptr, uint64_t new_size) {
+  auto& inode = *inode_ptr;
+
+  if (hasSmallData(inode)) {
+    if (new_size > getSmallDataCapacity(inode) && growSmallData(inode, new_size) < 0) {
+      return -1;
+    }
+  }
+
+  if (hasSmallData(inode)) {
+    if (new_size < inode.file_size) {
+      memset(getSmallData(inode) + new_size, 0, inode.file_size - new_size);
+    }
+
+    setFileSize(inode, new_size);
+    return 0;
+  }
+
+  uint64_t freed_block_count;
+  if (inode.inodes_list.truncate(blocks_, (new_size + BLOCK_SIZE - 1) / BLOCK_SIZE, &freed_block_count) < 0) {
+    std::abort();
+  }
+  setBlocksCount(inode, inode.blocks_count - freed_block_count);
+
+  // bytes after the end of file should read as zeros if the file grows again
+  if (new_size < inode.file_size && new_size % BLOCK_SIZE != 0) {
+    uint64_t run_length;
+    uint32_t flags;
+    id_t block_id = inode.inodes_list.getRunByIndex(blocks_, new_size / BLOCK_SIZE, &run_length, &flags);
+    if (!(flags & (EXTENT_HOLE | EXTENT_UNWRITTEN))) {
+      memset(blocks_->getBlockById(block_id).bytes + new_size % BLOCK_SIZE, 0, BLOCK_SIZE - new_size % BLOCK_SIZE);
+    }
+  }
+
+  setFileSize(inode, new_size);
+  return 0;
+}
+
+int Inodes::seekData(Inode* inode_ptr, uint64_t offset, uint64_t* result_ptr) {
+  return seekRun(*inode_ptr, offset, /*data=*/true, result_ptr);
+}
+
+int Inodes::seekHole(Inode* inode_ptr, uint64_t offset, uint64_t* result_ptr) {
+  return seekRun(*inode_ptr, offset, /*data=*/false, result_ptr);
+}
+
+bool Inodes::growFreesData(Inode& inode, uint64_t size) {
+  return inode.has_fragment_data && size > getSmallDataCapacity(inode);
+}
+
+bool Inodes::truncateFreesData(Inode& inode, uint64_t new_size) {
+  if (hasSmallData(inode)) {
+    return growFreesData(inode, new_size);
+  }
+
+  // reserved blocks after the end of file are freed too
+  return inode.inodes_list.size() > (new_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+void Inodes::moveData(Inode* from_ptr, Inode* to_ptr) {
+  auto& from = *from_ptr;
+  auto& to = *to_ptr;
+  assert(!from.is_dir && !to.is_dir);
+
+  freeData(to);
+
+  const bool has_inline_data = from.has_inline_data;
+  const bool has_fragment_data = from.has_fragment_data;
+  const InodesList inodes_list = from.inodes_list;
+  const uint64_t file_size = from.file_size;
+  const uint64_t blocks_count = from.blocks_count;
+
+  // the source is emptied first, so a crash in between leaks the content rather than leaves it in both files
+  memset(getInlineData(from), 0, INODE_INLINE_DATA_SIZE);
+  from.has_inline_data = true;
+  from.has_fragment_data = false;
+  setFileSize(from, 0);
+  setBlocksCount(from, 0);
+
+  to.has_inline_data = has_inline_data;
+  to.has_fragment_data = has_fragment_data;
+  to.inodes_list = inodes_list;
+  setFileSize(to, file_size);
+  setBlocksCount(to, blocks_count);
+}
+
+int Inodes::copyData(Inode* from_ptr, Inode* to_ptr, uint64_t size) {
+  uint64_t offset = 0;
+  while (offset < size && seekData(from_ptr, offset, &offset) == 0 && offset < size) {
+    uint64_t end;
+    if (seekHole(from_ptr, offset, &end) < 0) {
+      return -1;
+    }
+
+    std::vector<iovec> ranges;
+    if (mapRange(from_ptr, offset, std::min(end, size) - offset, &ranges) < 0) {
+      return -1;
+    }
+
+    for (const iovec& range : ranges) {
+      if (write(to_ptr, range.iov_base, offset, range.iov_len) < 0) {
+        return -1;
+      }
+      offset += range.iov_len;
+    }
+  }
+
+  return truncate(to_ptr, size);
+}
+
+int Inodes::createInode(uint64_t parent_inode_id, bool is_dir, uint64_t* created_id) {
+  uint64_t hint = parent_inode_id;
+  if (is_dir) {
+    hint = groups_.groupStart(groups_.findEmptiestGroup());
+  }
 
-  uint64_t id = bit_set_.findCleanBit();
-  bit_set_.setBit(id);
+  uint64_t id;
+  if (groups_.allocate(hint, &id) < 0) {
+    return -1;
+  }
+
+  Inode& inode = getInodeById(id);
+  clearInode(&inode);
+  setIsDir(inode, is_dir);
 
-  clearInode(&getInodeById(id));
+  // most files are small, so they start inline, directories always use blocks
+  if (!is_dir) {
+    memset(getInlineData(inode), 0, INODE_INLINE_DATA_SIZE);
+    inode.has_inline_data = true;
+  }
 
-  return id;
+  *created_id = id;
+  return 0;
 }
 
 void Inodes::deleteInode(uint64_t inode_id) {
-  assert(bit_set_.getBit(inode_id));
+  assert(groups_.isAllocated(inode_id));
 
   if (Inode& inode = getInodeById(inode_id); inode.is_dir) {
     // delete all files and subdirectories
@@ -149,95 +499,666 @@ void Inodes::deleteInode(uint64_t inode_id) {
   }
 
   auto& inode = getInodeById(inode_id);
-  for (uint64_t i = 0; i < inode.blocks_count; ++i) {
-    if (blocks_->deleteBlock(inode.inodes_list.getBlockIdByIndex(blocks_, i)) < 0) {
-      std::abort();
-    }
+  if (inode.has_dir_index) {
+    freeDirIndex(inode);
   }
-  bit_set_.clearBit(inode_id);
 
-  ++(*free_inode_num_ptr_);
+  freeData(inode);
+
+  if (groups_.free(inode_id) < 0) {
+    std::abort();
+  }
 }
 
-int Inodes::addDirectoryEntry(Inode* inode_ptr, const char* name, bool is_dir) {
-  if (strlen(name) > MAX_LINK_NAME_LEN) {
+int Inodes::addDirectoryEntry(Inode* inode_ptr, std::string_view name, bool is_dir, uint64_t* created_id_ptr) {
+  if (name.size() > MAX_LINK_NAME_LEN) {
     return -1;
   }
 
-  uint64_t new_inode_id = createInode();
-  getInodeById(new_inode_id).is_dir = is_dir;
+  uint64_t new_inode_id;
+  if (createInode(getInodeId(inode_ptr), is_dir, &new_inode_id) < 0) {
+    return -1;
+  }
 
-  Link new_link = {.is_alive = true, .inode_id = new_inode_id};
-  strcpy(new_link.name, name);
+  if (linkDirectoryEntry(inode_ptr, name, is_dir, new_inode_id) < 0) {
+    deleteInode(new_inode_id);
+    return -1;
+  }
 
-  for (uint64_t i = 0; i * sizeof(Link) < inode_ptr->file_size; ++i) {
-    Link link;
-    read(inode_ptr, &link, i * sizeof(Link), sizeof(Link));
-    if (!link.is_alive) {
-      if (write(inode_ptr, &new_link, i * sizeof(Link), sizeof(Link)) < 0) {
+  *created_id_ptr = new_inode_id;
+  return 0;
+}
+
+int Inodes::linkDirectoryEntry(Inode* inode_ptr, std::string_view name, bool is_dir, uint64_t inode_id) {
+  auto& inode = *inode_ptr;
+
+  if (name.size() > MAX_LINK_NAME_LEN) {
+    return -1;
+  }
+
+  uint64_t link_index = inode.file_size / sizeof(Link);
+  uint64_t next_free_link = 0;
+  if (inode.dir_free_link_head != 0) {
+    link_index = inode.dir_free_link_head - 1;
+
+    Link free_link;
+    read(&inode, &free_link, link_index * sizeof(Link), sizeof(Link));
+    assert(!free_link.is_alive);
+    next_free_link = free_link.inode_id;
+  }
+
+  Link new_link = {.is_alive = true, .is_dir = is_dir, .inode_id = inode_id};
+  memcpy(new_link.name, name.data(), name.size());
+
+  if (write(&inode, &new_link, link_index * sizeof(Link), sizeof(Link)) < 0) {
+    return -1;
+  }
+
+  if (inode.dir_free_link_head != 0) {
+    inode.dir_free_link_head = next_free_link;
+    --inode.dir_free_link_count;
+  }
+
+  indexDirectoryEntry(inode, name, link_index);
+  return 0;
+}
+
+int Inodes::relinkDirectoryEntry(Inode* inode_ptr, uint64_t link_index, uint64_t inode_id) {
+  Link link;
+  if (read(inode_ptr, &link, link_index * sizeof(Link), sizeof(Link)) != sizeof(Link) || !link.is_alive) {
+    return -1;
+  }
+
+  // name doesn't change, so the hash index stays valid
+  link.inode_id = inode_id;
+  return write(inode_ptr, &link, link_index * sizeof(Link), sizeof(Link)) < 0 ? -1 : 0;
+}
+
+int Inodes::findDirectoryEntry(Inode* inode_ptr, std::string_view name, Link* link_ptr, uint64_t* link_index_ptr) {
+  auto& inode = *inode_ptr;
+
+  if (!inode.has_dir_index) {
+    for (uint64_t i = 0; i * sizeof(Link) < inode.file_size; ++i) {
+      read(&inode, link_ptr, i * sizeof(Link), sizeof(Link));
+      if (link_ptr->is_alive && link_ptr->name == name) {
+        if (link_index_ptr != nullptr) {
+          *link_index_ptr = i;
+        }
+        return 0;
+      }
+    }
+
+    return -1;
+  }
+
+  const uint64_t* slots = getDirIndexSlots(inode);
+  const uint64_t slot_mask = inode.dir_index_block_count * DIR_INDEX_SLOTS_IN_BLOCK_COUNT - 1;
+  const uint32_t hash = hashName(name);
+
+  // linear probing, the chain ends at the first empty slot
+  for (uint64_t slot = hash & slot_mask; slots[slot] != DIR_INDEX_EMPTY_SLOT; slot = (slot + 1) & slot_mask) {
+    if (slots[slot] == DIR_INDEX_TOMBSTONE || (slots[slot] >> 32) != hash) {
+      continue;
+    }
+
+    uint64_t link_index = (slots[slot] & UINT32_MAX) - 1;
+    read(&inode, link_ptr, link_index * sizeof(Link), sizeof(Link));
+    if (link_ptr->is_alive && link_ptr->name == name) {
+      if (link_index_ptr != nullptr) {
+        *link_index_ptr = link_index;
+      }
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+int Inodes::findDirectoryEntryUnlocked(Inode* inode_copy_ptr, std::string_view name, Link* link_ptr) const {
+  auto& inode = *inode_copy_ptr;
+
+  // names of links may be torn, so they are compared only up to the end of the buffer
+  auto matches = [&](const Link& link) {
+    return link.is_alive && std::string_view(link.name, strnlen(link.name, sizeof(link.name))) == name;
+  };
+
+  if (!inode.has_dir_index) {
+    for (uint64_t i = 0; i * sizeof(Link) < inode.file_size; ++i) {
+      if (readUnlocked(&inode, link_ptr, i * sizeof(Link), sizeof(Link)) != sizeof(Link)) {
         return -1;
       }
+      if (matches(*link_ptr)) {
+        return 0;
+      }
+    }
+
+    return -1;
+  }
+
+  const uint64_t block_count = inode.dir_index_block_count;
+  if (!std::has_single_bit(block_count) || inode.dir_index_start >= blocks_->blockCount() ||
+      block_count > blocks_->blockCount() - inode.dir_index_start) {
+    return -1;
+  }
 
+  uint64_t* slots = getDirIndexSlots(inode);
+  const uint64_t slot_count = block_count * DIR_INDEX_SLOTS_IN_BLOCK_COUNT;
+  const uint32_t hash = hashName(name);
+
+  // slots may be changed meanwhile, so the chain may have no empty slot to end at
+  uint64_t slot = hash & (slot_count - 1);
+  for (uint64_t probed = 0; probed < slot_count; ++probed, slot = (slot + 1) & (slot_count - 1)) {
+    const uint64_t entry = std::atomic_ref<uint64_t>(slots[slot]).load(std::memory_order_relaxed);
+    if (entry == DIR_INDEX_EMPTY_SLOT) {
+      break;
+    }
+    if (entry == DIR_INDEX_TOMBSTONE || (entry >> 32) != hash) {
+      continue;
+    }
+
+    uint64_t link_index = (entry & UINT32_MAX) - 1;
+    if (readUnlocked(&inode, link_ptr, link_index * sizeof(Link), sizeof(Link)) != sizeof(Link)) {
+      return -1;
+    }
+    if (matches(*link_ptr)) {
       return 0;
     }
   }
 
-  if (append(inode_ptr, &new_link, sizeof(Link)) < 0) {
+  return -1;
+}
+
+int Inodes::removeDirectoryEntry(Inode* inode_ptr, uint64_t link_index) {
+  auto& inode = *inode_ptr;
+
+  Link link;
+  read(&inode, &link, link_index * sizeof(Link), sizeof(Link));
+  assert(link.is_alive);
+
+  const uint32_t hash = hashName(link.name);
+
+  link.is_alive = false;
+  link.inode_id = inode.dir_free_link_head;
+  if (write(&inode, &link, link_index * sizeof(Link), sizeof(Link)) < 0) {
     return -1;
   }
 
+  inode.dir_free_link_head = link_index + 1;
+  ++inode.dir_free_link_count;
+
+  if (inode.has_dir_index) {
+    unindexDirectoryEntry(inode, hash, link_index);
+  }
+
+  // compaction is linear, but it happens once per link_count / 2 deletes
+  uint64_t link_count = inode.file_size / sizeof(Link);
+  if (link_count >= DIR_COMPACTION_MIN_LINK_COUNT && inode.dir_free_link_count * 2 > link_count) {
+    return compactDirectory(&inode);
+  }
+
+  return 0;
+}
+
+int Inodes::compactDirectory(Inode* inode_ptr) {
+  auto& inode = *inode_ptr;
+
+  // links only move to lower indices, which are already allocated, so rewriting them can't fail
+  uint64_t alive_count = 0;
+  for (uint64_t i = 0; i * sizeof(Link) < inode.file_size; ++i) {
+    Link link;
+    read(&inode, &link, i * sizeof(Link), sizeof(Link));
+    if (!link.is_alive) {
+      continue;
+    }
+
+    if (alive_count != i && write(&inode, &link, alive_count * sizeof(Link), sizeof(Link)) < 0) {
+      std::abort();
+    }
+    ++alive_count;
+  }
+
+  if (truncate(&inode, alive_count * sizeof(Link)) < 0) {
+    std::abort();
+  }
+
+  inode.dir_free_link_count = 0;
+  inode.dir_free_link_head = 0;
+
+  if (alive_count >= DIR_INDEX_MIN_LINK_COUNT) {
+    // failed build leaves the directory without index
+    buildDirIndex(inode, getDirIndexBlockCount(alive_count));
+  } else if (inode.has_dir_index) {
+    freeDirIndex(inode);
+  }
+
   return 0;
 }
 
+uint32_t Inodes::hashName(std::string_view name) {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (char c : name) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+
+  return hash;
+}
+
+uint64_t Inodes::getDirIndexBlockCount(uint64_t link_count) {
+  // no more than a quarter of slots are used right after build
+  return std::bit_ceil(link_count * 4 / DIR_INDEX_SLOTS_IN_BLOCK_COUNT + 1);
+}
+
+uint64_t* Inodes::getDirIndexSlots(Inode& inode) const {
+  return reinterpret_cast<uint64_t*>(blocks_->getBlockById(inode.dir_index_start).bytes);
+}
+
+void Inodes::indexDirectoryEntry(Inode& inode, std::string_view name, uint64_t link_index) {
+  if (!inode.has_dir_index) {
+    if (uint64_t link_count = inode.file_size / sizeof(Link);
+        link_count >= std::max(DIR_INDEX_MIN_LINK_COUNT, inode.dir_index_retry_link_count)) {
+      buildDirIndex(inode, getDirIndexBlockCount(link_count));
+    }
+    return;
+  }
+
+  const uint64_t slot_count = inode.dir_index_block_count * DIR_INDEX_SLOTS_IN_BLOCK_COUNT;
+  if ((inode.dir_index_used_slot_count + 1) * 2 > slot_count) {
+    // rebuild gets rid of tombstones, the new link is already written, so it is picked up too
+    uint64_t block_count = inode.dir_index_block_count;
+    if ((inode.dir_index_entry_count + 1) * 4 > slot_count) {
+      block_count *= 2;
+    }
+
+    buildDirIndex(inode, block_count);
+    return;
+  }
+
+  uint64_t* slots = getDirIndexSlots(inode);
+  const uint64_t slot_mask = slot_count - 1;
+  const uint32_t hash = hashName(name);
+
+  uint64_t slot = hash & slot_mask;
+  while (slots[slot] != DIR_INDEX_EMPTY_SLOT && slots[slot] != DIR_INDEX_TOMBSTONE) {
+    slot = (slot + 1) & slot_mask;
+  }
+
+  if (slots[slot] == DIR_INDEX_EMPTY_SLOT) {
+    ++inode.dir_index_used_slot_count;
+  }
+
+  slots[slot] = (uint64_t{hash} << 32) | (link_index + 1);
+  ++inode.dir_index_entry_count;
+}
+
+void Inodes::unindexDirectoryEntry(Inode& inode, uint32_t hash, uint64_t link_index) {
+  uint64_t* slots = getDirIndexSlots(inode);
+  const uint64_t slot_mask = inode.dir_index_block_count * DIR_INDEX_SLOTS_IN_BLOCK_COUNT - 1;
+  const uint64_t entry = (uint64_t{hash} << 32) | (link_index + 1);
+
+  for (uint64_t slot = hash & slot_mask; slots[slot] != DIR_INDEX_EMPTY_SLOT; slot = (slot + 1) & slot_mask) {
+    if (slots[slot] == entry) {
+      // chains going through the slot must stay unbroken
+      slots[slot] = DIR_INDEX_TOMBSTONE;
+      --inode.dir_index_entry_count;
+      return;
+    }
+  }
+
+  // every alive link is in the index
+  std::abort();
+}
+
 int Inodes::addBlockToInode(Inode& inode, uint64_t block_id) {
   if (inode.inodes_list.addBlock(blocks_, block_id) < 0) {
     return -1;
   }
 
-  ++inode.blocks_count;
+  setBlocksCount(inode, inode.blocks_count + 1);
   return 0;
 }
 
-[[maybe_unused]] int Inodes::gcLaterRename(uint64_t) {
+int Inodes::freeTailBlocks(Inode* inode_ptr, uint64_t max_block_count, bool* is_empty_ptr) {
+  auto& inode = *inode_ptr;
+
+  // small data is freed with the inode itself
+  if (hasSmallData(inode)) {
+    *is_empty_ptr = true;
+    return 0;
+  }
+
+  // reserved blocks after the end of file count too
+  uint64_t end_index = inode.inodes_list.size();
+  uint64_t new_end_index = (end_index > max_block_count) ? end_index - max_block_count : 0;
+
+  uint64_t freed_block_count;
+  if (inode.inodes_list.truncate(blocks_, new_end_index, &freed_block_count) < 0) {
+    return -1;
+  }
+
+  setBlocksCount(inode, inode.blocks_count - freed_block_count);
+  setFileSize(inode, std::min(inode.file_size, new_end_index * BLOCK_SIZE));
+
+  *is_empty_ptr = (new_end_index == 0);
   return 0;
 }
 
+void Inodes::restoreFragments() {
+  for (uint64_t inode_id = 0; inode_id < groups_.groupNum() * groups_.groupSize(); ++inode_id) {
+    if (groups_.isAllocated(inode_id) && getInodeById(inode_id).has_fragment_data) {
+      fragments_->markAllocated(getFragmentRun(getInodeById(inode_id)));
+    }
+  }
+}
+
 int Inodes::clearInode(Inode* inode_ptr) {
+  inode_ptr->has_inline_data = false;
+  inode_ptr->has_fragment_data = false;
+  inode_ptr->has_dir_index = false;
+  inode_ptr->dir_index_retry_link_count = 0;
+  inode_ptr->dir_free_link_count = 0;
+  inode_ptr->dir_free_link_head = 0;
+  inode_ptr->is_orphan = false;
+  inode_ptr->orphan_next = 0;
   inode_ptr->inodes_list.clear();
-  inode_ptr->file_size = 0;
-  inode_ptr->blocks_count = 0;
+  setFileSize(*inode_ptr, 0);
+  setBlocksCount(*inode_ptr, 0);
+
+  return 0;
+}
+
+void Inodes::setIsDir(Inode& inode, bool is_dir) {
+  InodeSync& sync = beginStatChange(inode);
+  std::atomic_ref<bool>(inode.is_dir).store(is_dir, std::memory_order_relaxed);
+  endStatChange(sync);
+}
+
+void Inodes::setFileSize(Inode& inode, uint64_t file_size) {
+  InodeSync& sync = beginStatChange(inode);
+  std::atomic_ref<uint64_t>(inode.file_size).store(file_size, std::memory_order_relaxed);
+  endStatChange(sync);
+}
+
+void Inodes::setBlocksCount(Inode& inode, uint64_t blocks_count) {
+  InodeSync& sync = beginStatChange(inode);
+  std::atomic_ref<uint64_t>(inode.blocks_count).store(blocks_count, std::memory_order_relaxed);
+  endStatChange(sync);
+}
+
+InodeSync& Inodes::beginStatChange(const Inode& inode) {
+  // writers hold the exclusive lock of the inode, so they don't race each other here
+  InodeSync& sync = inode_syncs_[getInodeId(&inode)];
+  sync.stat_version.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  return sync;
+}
+
+void Inodes::endStatChange(InodeSync& sync) {
+  sync.stat_version.fetch_add(1, std::memory_order_release);
+}
+
+void Inodes::freeData(Inode& inode) {
+  if (inode.has_fragment_data) {
+    fragments_->free(getFragmentRun(inode));
+  } else if (!inode.has_inline_data && inode.inodes_list.freeBlocks(blocks_) < 0) {
+    std::abort();
+  }
+
+  setBlocksCount(inode, 0);
+}
+
+uint8_t* Inodes::getSmallData(Inode& inode) const {
+  if (inode.has_fragment_data) {
+    return fragments_->getBytes(getFragmentRun(inode));
+  }
+
+  return getInlineData(inode);
+}
+
+uint64_t Inodes::getSmallDataCapacity(Inode& inode) {
+  if (inode.has_fragment_data) {
+    return getFragmentRun(inode).count * FRAGMENT_SIZE;
+  }
+
+  return INODE_INLINE_DATA_SIZE;
+}
+
+int Inodes::growSmallData(Inode& inode, uint64_t size) {
+  assert(hasSmallData(inode));
+  assert(inode.file_size <= getSmallDataCapacity(inode));
+
+  uint8_t data[BLOCK_SIZE];
+  memcpy(data, getSmallData(inode), inode.file_size);
+
+  const bool had_fragment_data = inode.has_fragment_data;
+  const FragmentRun old_run = had_fragment_data ? getFragmentRun(inode) : FragmentRun{};
+
+  if (uint64_t fragment_count = (size + FRAGMENT_SIZE - 1) / FRAGMENT_SIZE; fragment_count < FRAGMENTS_IN_BLOCK_COUNT) {
+    FragmentRun run;
+    if (fragments_->allocate(fragment_count, had_fragment_data ? old_run.block_id : getBlockHint(inode), &run) < 0) {
+      return -1;
+    }
+
+    uint8_t* bytes = fragments_->getBytes(run);
+    memcpy(bytes, data, inode.file_size);
+    memset(bytes + inode.file_size, 0, run.count * FRAGMENT_SIZE - inode.file_size);
+
+    inode.has_inline_data = false;
+    inode.has_fragment_data = true;
+    getFragmentRun(inode) = run;
+  } else {
+    inode.has_inline_data = false;
+    inode.has_fragment_data = false;
+    inode.inodes_list.clear();
+    setBlocksCount(inode, 0);
+
+    // file size is already set, so write doesn't change it
+    if (inode.file_size != 0 && write(&inode, data, 0, inode.file_size) < 0) {
+      if (inode.inodes_list.freeBlocks(blocks_) < 0) {
+        std::abort();
+      }
+      setBlocksCount(inode, 0);
+
+      if (had_fragment_data) {
+        inode.has_fragment_data = true;
+        getFragmentRun(inode) = old_run;
+      } else {
+        inode.has_inline_data = true;
+        memcpy(getInlineData(inode), data, inode.file_size);
+        memset(getInlineData(inode) + inode.file_size, 0, INODE_INLINE_DATA_SIZE - inode.file_size);
+      }
+
+      return -1;
+    }
+  }
+
+  if (had_fragment_data) {
+    fragments_->free(old_run);
+  }
+
+  return 0;
+}
+
+id_t Inodes::getBlockHint(Inode& inode) {
+  return blocks_->groupStart(groups_.groupOf(getInodeId(&inode)) * blocks_->groupNum() / groups_.groupNum());
+}
+
+int Inodes::buildDirIndex(Inode& inode, uint64_t block_count) {
+  assert(std::has_single_bit(block_count));
+
+  // slots are addressed as a single array, so the index needs one run of blocks
+  std::vector<BlockRange> ranges;
+  if (blocks_->createBlocks(block_count, getBlockHint(inode), &ranges) < 0 || ranges.size() != 1) {
+    for (const auto& range : ranges) {
+      blocks_->deleteBlocks(range);
+    }
+
+    if (inode.has_dir_index) {
+      freeDirIndex(inode);
+    }
+
+    // every build scans the whole directory, so it's retried only after the directory doubles
+    inode.dir_index_retry_link_count = 2 * (inode.file_size / sizeof(Link));
+    return -1;
+  }
+
+  if (inode.has_dir_index) {
+    freeDirIndex(inode);
+  }
+
+  inode.has_dir_index = true;
+  inode.dir_index_retry_link_count = 0;
+  inode.dir_index_start = ranges[0].start;
+  inode.dir_index_block_count = block_count;
+  inode.dir_index_entry_count = 0;
+  inode.dir_index_used_slot_count = 0;
+
+  uint64_t* slots = getDirIndexSlots(inode);
+  const uint64_t slot_mask = block_count * DIR_INDEX_SLOTS_IN_BLOCK_COUNT - 1;
+  memset(slots, 0, block_count * BLOCK_SIZE);
+
+  for (uint64_t i = 0; i * sizeof(Link) < inode.file_size; ++i) {
+    Link link;
+    read(&inode, &link, i * sizeof(Link), sizeof(Link));
+    if (!link.is_alive) {
+      continue;
+    }
+
+    const uint32_t hash = hashName(link.name);
+    uint64_t slot = hash & slot_mask;
+    while (slots[slot] != DIR_INDEX_EMPTY_SLOT) {
+      slot = (slot + 1) & slot_mask;
+    }
+
+    slots[slot] = (uint64_t{hash} << 32) | (i + 1);
+    ++inode.dir_index_entry_count;
+    ++inode.dir_index_used_slot_count;
+  }
 
   return 0;
 }
 
-Block& Inodes::getBlockByIndex(Inode& inode, uint64_t index) const {
-  return blocks_->getBlockById(inode.inodes_list.getBlockIdByIndex(blocks_, index));
+void Inodes::freeDirIndex(Inode& inode) {
+  assert(inode.has_dir_index);
+
+  if (blocks_->deleteBlocks({.start = inode.dir_index_start, .length = inode.dir_index_block_count}) < 0) {
+    std::abort();
+  }
+
+  inode.has_dir_index = false;
+  inode.dir_index_block_count = 0;
+  inode.dir_index_entry_count = 0;
+  inode.dir_index_used_slot_count = 0;
 }
 
-int Inodes::extend(Inode& inode, uint64_t new_size) {
-  uint64_t exact_block_count = (new_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
-  if (exact_block_count - inode.blocks_count > blocks_->getFreeBlockNum() ||
-      exact_block_count > InodesList::max_size()) {
+int Inodes::allocateBlocks(Inode& inode, uint64_t first_index, uint64_t end_index) {
+  if (end_index > InodesList::max_size()) {
     return -1;
   }
 
-  while (inode.blocks_count != exact_block_count) {
-    id_t new_block_id;
+  // blocks of all holes and nodes for their extents are allocated before the list is changed, so a write that doesn't
+  // fit fails without filling some of the holes
+  std::vector<IdRange> holes;
+  std::vector<BlockRange> new_ranges;
+  for (uint64_t index = first_index; index < end_index;) {
+    uint64_t run_length;
+    uint32_t flags;
+    inode.inodes_list.getRunByIndex(blocks_, index, &run_length, &flags);
+    run_length = std::min(run_length, end_index - index);
 
-    if (blocks_->createBlock(&new_block_id) < 0 || addBlockToInode(inode, new_block_id) < 0) {
+    if ((flags & EXTENT_HOLE) && blocks_->createBlocks(run_length, getHoleHint(inode, index), &new_ranges) < 0) {
+      freeRanges(new_ranges);
       return -1;
     }
+
+    if (flags & EXTENT_HOLE) {
+      holes.push_back({.start = index, .length = run_length});
+    }
+    index += run_length;
   }
 
-  inode.file_size = new_size;
+  if (holes.empty()) {
+    return 0;
+  }
+
+  std::vector<id_t> free_nodes;
+  if (InodesList::allocateNodes(blocks_, inode.inodes_list.maxNodesToInsert(new_ranges.size()),
+                                new_ranges.back().start + new_ranges.back().length, &free_nodes) < 0) {
+    freeRanges(new_ranges);
+    return -1;
+  }
 
+  // ranges of each hole follow each other in the order of holes
+  auto range_it = new_ranges.begin();
+  for (const auto& hole : holes) {
+    for (uint64_t index = hole.start; index < hole.start + hole.length; ++range_it) {
+      int rc = inode.inodes_list.addRange(blocks_, index, *range_it, /*unwritten=*/true, &free_nodes);
+      assert(rc == 0);
+      FSC_USED_BY_ASSERT(rc);
+
+      setBlocksCount(inode, inode.blocks_count + range_it->length);
+      index += range_it->length;
+    }
+  }
+
+  InodesList::freeNodes(blocks_, free_nodes);
   return 0;
 }
-Inodes::Inodes(void* inodes_ptr_start, Blocks* blocks, uint64_t* free_inode_num_ptr, BitSet inodes_bitset)
-    : inodes_ptr_start_(static_cast<Inode*>(inodes_ptr_start)),
-      blocks_(blocks),
-      free_inode_num_ptr_(free_inode_num_ptr),
-      bit_set_(std::move(inodes_bitset)) {
+
+id_t Inodes::getHoleHint(Inode& inode, uint64_t index) {
+  // continue the run of the previous block if possible, otherwise start in the block group matching inode's group
+  if (index != 0) {
+    uint64_t run_length;
+    uint32_t flags;
+    id_t prev_block_id = inode.inodes_list.getRunByIndex(blocks_, index - 1, &run_length, &flags);
+    if (!(flags & EXTENT_HOLE)) {
+      return prev_block_id + 1;
+    }
+  }
+
+  return getBlockHint(inode);
+}
+
+void Inodes::freeRanges(const std::vector<BlockRange>& ranges) {
+  for (const auto& range : ranges) {
+    if (blocks_->deleteBlocks(range) < 0) {
+      std::abort();
+    }
+  }
+}
+
+int Inodes::seekRun(Inode& inode, uint64_t offset, bool data, uint64_t* result_ptr) {
+  if (offset >= inode.file_size) {
+    return -1;
+  }
+
+  if (hasSmallData(inode)) {
+    *result_ptr = data ? offset : inode.file_size;
+    return 0;
+  }
+
+  for (uint64_t index = offset / BLOCK_SIZE; index * BLOCK_SIZE < inode.file_size;) {
+    uint64_t run_length;
+    uint32_t flags;
+    inode.inodes_list.getRunByIndex(blocks_, index, &run_length, &flags);
+
+    // unwritten blocks read as zeros, so they are a hole for the reader
+    bool is_data = !(flags & (EXTENT_HOLE | EXTENT_UNWRITTEN));
+    if (is_data == data) {
+      *result_ptr = std::max(offset, index * BLOCK_SIZE);
+      return 0;
+    }
+
+    index += run_length;
+  }
+
+  if (data) {
+    return -1;
+  }
+
+  // there is an implicit hole at the end of file
+  *result_ptr = inode.file_size;
+  return 0;
 }
 
-}  // namespace fspp::internal
\ No newline at end of file
+}  // namespace fspp::internal
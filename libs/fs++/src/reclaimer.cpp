@@ -0,0 +1,245 @@
+#include "fs++/internal/reclaimer.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <utility>
+
+namespace fspp::internal {
+
+Reclaimer::~Reclaimer() {
+  stop();
+}
+
+void Reclaimer::start(Inodes* inodes, DentryCache* dentry_cache, OrphanList orphans) {
+  assert(!thread_.joinable());
+
+  inodes_ = inodes;
+  dentry_cache_ = dentry_cache;
+  orphans_ = orphans;
+  is_stopped_ = false;
+  is_idle_ = (*orphans_.count_ptr == 0);
+  thread_ = std::thread(&Reclaimer::run, this);
+}
+
+void Reclaimer::stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard guard(mutex_);
+    is_stopped_ = true;
+  }
+  work_cv_.notify_one();
+  thread_.join();
+
+  // nobody would wake waiters up anymore
+  idle_cv_.notify_all();
+}
+
+void Reclaimer::addOrphan(uint64_t inode_id) {
+  {
+    std::lock_guard guard(mutex_);
+    addOrphanLocked(inode_id);
+    is_idle_ = false;
+  }
+  work_cv_.notify_one();
+}
+
+void Reclaimer::pin(uint64_t inode_id) {
+  std::lock_guard guard(mutex_);
+  ++pins_[inode_id];
+}
+
+void Reclaimer::unpin(uint64_t inode_id) {
+  {
+    std::lock_guard guard(mutex_);
+    auto it = pins_.find(inode_id);
+    assert(it != pins_.end());
+    if (--it->second != 0) {
+      return;
+    }
+
+    pins_.erase(it);
+    if (!inodes_->getInodeById(inode_id).is_orphan) {
+      return;
+    }
+    is_idle_ = false;
+  }
+  work_cv_.notify_one();
+}
+
+bool Reclaimer::isOrphan(uint64_t inode_id) {
+  std::lock_guard guard(mutex_);
+  return inodes_->getInodeById(inode_id).is_orphan;
+}
+
+void Reclaimer::map(uint64_t inode_id) {
+  std::lock_guard guard(mutex_);
+  ++mappings_[inode_id].count;
+}
+
+void Reclaimer::unmap(uint64_t inode_id) {
+  std::vector<uint64_t> holder_ids;
+  {
+    std::lock_guard guard(mutex_);
+    auto it = mappings_.find(inode_id);
+    assert(it != mappings_.end());
+    if (--it->second.count != 0) {
+      return;
+    }
+
+    holder_ids = std::move(it->second.holder_ids);
+    mappings_.erase(it);
+  }
+
+  for (uint64_t holder_id : holder_ids) {
+    unpin(holder_id);
+  }
+}
+
+bool Reclaimer::isMapped(uint64_t inode_id) {
+  std::lock_guard guard(mutex_);
+  return mappings_.contains(inode_id);
+}
+
+void Reclaimer::holdUntilUnmapped(uint64_t inode_id, uint64_t holder_id) {
+  {
+    std::lock_guard guard(mutex_);
+    if (auto it = mappings_.find(inode_id); it != mappings_.end()) {
+      it->second.holder_ids.push_back(holder_id);
+      return;
+    }
+  }
+
+  unpin(holder_id);
+}
+
+void Reclaimer::waitForIdle() {
+  std::unique_lock lock(mutex_);
+  idle_cv_.wait(lock, [this] { return is_idle_ || is_stopped_; });
+}
+
+void Reclaimer::run() {
+  std::unique_lock lock(mutex_);
+  while (!is_stopped_) {
+    uint64_t inode_id;
+    uint64_t prev_id;
+    InodeLock inode_lock;
+    bool has_busy = false;
+    if (!findReclaimable(&inode_id, &prev_id, &inode_lock, &has_busy)) {
+      is_idle_ = true;
+      idle_cv_.notify_all();
+      // locks don't notify, so busy orphans are polled
+      if (has_busy) {
+        work_cv_.wait_for(lock, RECLAIM_RETRY_INTERVAL, [this] { return is_stopped_ || !is_idle_; });
+        is_idle_ = false;
+      } else {
+        work_cv_.wait(lock, [this] { return is_stopped_ || !is_idle_; });
+      }
+      continue;
+    }
+
+    // the lock is held for a single bounded step, deletions and pins wait at most for one batch
+    if (reclaimStep(inode_id)) {
+      // inode may be reused as soon as it's freed, so it leaves the list first
+      removeOrphanLocked(inode_id, prev_id);
+      inodes_->deleteInode(inode_id);
+    }
+  }
+}
+
+bool Reclaimer::findReclaimable(uint64_t* inode_id_ptr, uint64_t* prev_id_ptr, InodeLock* lock_ptr,
+                                bool* has_busy_ptr) {
+  uint64_t prev_id = 0;
+  for (uint64_t next = *orphans_.head_ptr; next != 0; next = inodes_->getInodeById(next - 1).orphan_next) {
+    if (!pins_.contains(next - 1)) {
+      // pins are taken under inode lock, so an orphan locked here can't be pinned until it's unlocked
+      InodeLock inode_lock = inodes_->tryLockInode(next - 1);
+      if (inode_lock.ownsLock()) {
+        *inode_id_ptr = next - 1;
+        *prev_id_ptr = prev_id;
+        *lock_ptr = std::move(inode_lock);
+        return true;
+      }
+
+      *has_busy_ptr = true;
+    }
+    prev_id = next;
+  }
+
+  return false;
+}
+
+bool Reclaimer::reclaimStep(uint64_t inode_id) {
+  Inode& inode = inodes_->getInodeById(inode_id);
+
+  if (inode.is_dir) {
+    // walks that entered the directory before it was deleted could cache its links again, nobody can enter it now
+    dentry_cache_->forgetDirectory(inode_id);
+
+    // links are dropped from the end, so the directory stays consistent between steps
+    for (uint64_t i = 0; i < RECLAIM_BATCH_LINK_COUNT && inode.file_size >= sizeof(Link); ++i) {
+      uint64_t last_offset = inode.file_size - sizeof(Link);
+
+      Link link;
+      inodes_->read(&inode, &link, last_offset, sizeof(Link));
+      // child is already an orphan if the previous mount crashed right after orphaning it
+      if (link.is_alive && !inodes_->getInodeById(link.inode_id).is_orphan) {
+        addOrphanLocked(link.inode_id);
+      }
+
+      if (inodes_->truncate(&inode, last_offset) < 0) {
+        std::abort();
+      }
+    }
+
+    if (inode.file_size >= sizeof(Link)) {
+      return false;
+    }
+  }
+
+  bool is_empty;
+  if (inodes_->freeTailBlocks(&inode, RECLAIM_BATCH_BLOCK_COUNT, &is_empty) < 0) {
+    std::abort();
+  }
+
+  return is_empty;
+}
+
+void Reclaimer::addOrphanLocked(uint64_t inode_id) {
+  Inode& inode = inodes_->getInodeById(inode_id);
+  assert(!inode.is_orphan);
+
+  inode.is_orphan = true;
+  inode.orphan_next = 0;
+  if (*orphans_.tail_ptr == 0) {
+    *orphans_.head_ptr = inode_id + 1;
+  } else {
+    inodes_->getInodeById(*orphans_.tail_ptr - 1).orphan_next = inode_id + 1;
+  }
+
+  *orphans_.tail_ptr = inode_id + 1;
+  ++*orphans_.count_ptr;
+}
+
+void Reclaimer::removeOrphanLocked(uint64_t inode_id, uint64_t prev_id) {
+  uint64_t next = inodes_->getInodeById(inode_id).orphan_next;
+  if (prev_id == 0) {
+    *orphans_.head_ptr = next;
+  } else {
+    inodes_->getInodeById(prev_id - 1).orphan_next = next;
+  }
+
+  if (*orphans_.tail_ptr == inode_id + 1) {
+    *orphans_.tail_ptr = prev_id;
+  }
+
+  --*orphans_.count_ptr;
+
+  Inode& inode = inodes_->getInodeById(inode_id);
+  inode.is_orphan = false;
+  inode.orphan_next = 0;
+}
+
+}  // namespace fspp::internal
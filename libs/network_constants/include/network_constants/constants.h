@@ -5,5 +5,8 @@
 const char cok[] = "cok";
 const char sok[] = "sok";
 
+// text responses end with this byte, it never occurs inside them
+const char RESPONSE_END = '\0';
+
 const uint64_t MAX_QUERY_LEN = 4096;
 const uint64_t MAX_TRANSMISSION_LEN = 4096;
\ No newline at end of file
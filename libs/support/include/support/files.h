@@ -1,6 +1,13 @@
 #pragma once
 
+#include <sys/uio.h>
+
 #include <cstdlib>
 
 ssize_t readall(int fd, void* buf, size_t count);
 ssize_t writeall(int fd, const void* buf, size_t count);
+// writes all ranges with as few writev calls as possible, _iov_ is modified
+ssize_t writevall(int fd, struct iovec* iov, size_t iovcnt);
+ssize_t pwritevall(int fd, struct iovec* iov, size_t iovcnt, off_t offset);
+// moves _iov_ptr_ past _count_ written bytes, fully written ranges are dropped
+void skip_written(struct iovec** iov_ptr, size_t* iovcnt_ptr, size_t count);
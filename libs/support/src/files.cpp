@@ -1,5 +1,6 @@
 #include "support/files.h"
 
+#include <algorithm>
 #include <climits>
 #include <unistd.h>
 
@@ -40,3 +41,48 @@ ssize_t writeall(int fd, const void* buf, size_t count) {
 
   return bytes_written;
 }
+
+void skip_written(struct iovec** iov_ptr, size_t* iovcnt_ptr, size_t count) {
+  while (*iovcnt_ptr != 0 && (count != 0 || (*iov_ptr)->iov_len == 0)) {
+    struct iovec* iov = *iov_ptr;
+    size_t skipped = std::min(count, iov->iov_len);
+    iov->iov_base = (char*)iov->iov_base + skipped;
+    iov->iov_len -= skipped;
+    count -= skipped;
+
+    if (iov->iov_len == 0) {
+      ++*iov_ptr;
+      --*iovcnt_ptr;
+    }
+  }
+}
+
+ssize_t writevall(int fd, struct iovec* iov, size_t iovcnt) {
+  ssize_t bytes_written = 0;
+  while (iovcnt != 0) {
+    ssize_t bytes_written_last_time = writev(fd, iov, (int)std::min(iovcnt, (size_t)IOV_MAX));
+    if (bytes_written_last_time < 0) {
+      return -1;
+    }
+
+    bytes_written += bytes_written_last_time;
+    skip_written(&iov, &iovcnt, bytes_written_last_time);
+  }
+
+  return bytes_written;
+}
+
+ssize_t pwritevall(int fd, struct iovec* iov, size_t iovcnt, off_t offset) {
+  ssize_t bytes_written = 0;
+  while (iovcnt != 0) {
+    ssize_t bytes_written_last_time = pwritev(fd, iov, (int)std::min(iovcnt, (size_t)IOV_MAX), offset + bytes_written);
+    if (bytes_written_last_time < 0) {
+      return -1;
+    }
+
+    bytes_written += bytes_written_last_time;
+    skip_written(&iov, &iovcnt, bytes_written_last_time);
+  }
+
+  return bytes_written;
+}
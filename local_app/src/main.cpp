@@ -1,8 +1,13 @@
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <regex>
+#include <vector>
 
 #include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 
 #include <fcntl.h>
 #include <sys/mman.h>
@@ -10,6 +15,12 @@
 #include <unistd.h>
 
 #include <fs++/filesystem_client.h>
+#include <support/files.h>
+
+// lsdir prints directory entries in pages of this size
+const uint64_t LSDIR_PAGE_SIZE = 256;
+// load writes file content in chunks of this size
+const uint64_t LOAD_CHUNK_SIZE = 64 * 1024 * 1024;
 
 int mkfile(fspp::FileSystemClient& fs, const std::string& query) {
   static const std::regex full_regex(R"(^\s*mkfile\s+(/|((/[\w.]+)+))\s*$)");
@@ -24,17 +35,13 @@ int mkfile(fspp::FileSystemClient& fs, const std::string& query) {
   const std::string& path = match[1];
   std::cerr << "(path=" << path << ") ";
 
-  if (fs.existsDir(path)) {
-    std::cout << "Already exists directory with the same name" << std::endl;
-    return -1;
-  }
-
-  if (fs.existsFile(path)) {
-    std::cout << "File already exists" << std::endl;
-    return -1;
-  }
-
-  if (fs.createFile(path) < 0) {
+  // path is resolved once more only to explain a failure
+  if (fs.createFile(path, /*fail_if_exists=*/true) < 0) {
+    fspp::FileStat stat_buf;
+    if (fs.stat(path, &stat_buf) == 0) {
+      std::cout << (stat_buf.is_dir ? "Already exists directory with the same name" : "File already exists")
+                << std::endl;
+    }
     return -1;
   }
 
@@ -54,12 +61,10 @@ int rmfile(fspp::FileSystemClient& fs, const std::string& query) {
   const std::string& path = match[1];
   std::cerr << "(path=" << path << ") ";
 
-  if (!fs.existsFile(path)) {
-    std::cout << "File doesn't exist" << std::endl;
-    return -1;
-  }
-
   if (fs.deleteFile(path) < 0) {
+    if (!fs.existsFile(path)) {
+      std::cout << "File doesn't exist" << std::endl;
+    }
     return -1;
   }
 
@@ -79,17 +84,12 @@ int mkdir(fspp::FileSystemClient& fs, const std::string& query) {
   const std::string& path = match[1];
   std::cerr << "(path=" << path << ") ";
 
-  if (fs.existsDir(path)) {
-    std::cout << "Directory already exists" << std::endl;
-    return -1;
-  }
-
-  if (fs.existsFile(path)) {
-    std::cout << "Already exists file with the same name" << std::endl;
-    return -1;
-  }
-
   if (fs.createDir(path) < 0) {
+    fspp::FileStat stat_buf;
+    if (fs.stat(path, &stat_buf) == 0) {
+      std::cout << (stat_buf.is_dir ? "Directory already exists" : "Already exists file with the same name")
+                << std::endl;
+    }
     return -1;
   }
 
@@ -109,17 +109,15 @@ int rmdir(fspp::FileSystemClient& fs, const std::string& query) {
   const std::string& path = match[1];
   std::cerr << "(path=" << path << ") ";
 
-  if (!fs.existsDir(path)) {
-    std::cout << "Directory doesn't exist" << std::endl;
-    return -1;
-  }
-
   if (path == "/") {
     std::cout << "You can't remove root directory" << std::endl;
     return -1;
   }
 
   if (fs.deleteDir(path) < 0) {
+    if (!fs.existsDir(path)) {
+      std::cout << "Directory doesn't exist" << std::endl;
+    }
     return -1;
   }
 
@@ -139,17 +137,77 @@ int lsdir(fspp::FileSystemClient& fs, const std::string& query) {
   const std::string& path = match[1];
   std::cerr << "(path=" << path << ") ";
 
-  if (!fs.existsDir(path)) {
-    std::cout << "Directory doesn't exist" << std::endl;
+  std::vector<fspp::DirEntry> entries;
+  for (uint64_t cursor = 0; cursor != fspp::DIR_END_CURSOR;) {
+    entries.clear();
+    if (fs.readDir(path, &cursor, LSDIR_PAGE_SIZE, &entries) < 0) {
+      // the first page fails only if there is no such directory
+      std::cout << (cursor == 0 ? "Directory doesn't exist" : "") << std::endl;
+      return -1;
+    }
+
+    for (const auto& entry : entries) {
+      std::cout << entry.name << (entry.is_dir ? "/ " : " ");
+    }
+  }
+
+  std::cout << std::endl;
+
+  return 0;
+}
+
+int truncate(fspp::FileSystemClient& fs, const std::string& query) {
+  static const std::regex full_regex(R"(^\s*truncate\s+(/|(/[\w.]+)+)\s+(\d+)\s*$)");
+  std::cerr << "truncate command: ";
+
+  std::smatch match;
+  if (!std::regex_match(query, match, full_regex)) {
+    std::cout << "Wrong path or size format" << std::endl;
     return -1;
   }
 
-  std::string output;
-  if (fs.listDir(path, output) < 0) {
+  const std::string& path = match[1];
+  const std::string& size_str = match[3];
+  std::cerr << "(path=" << path << ") ";
+  std::cerr << "(size=" << size_str << ") ";
+
+  errno = 0;
+  uint64_t new_size = strtoull(size_str.c_str(), nullptr, 10);
+  if (errno == ERANGE) {
+    std::cout << "Size is too big" << std::endl;
     return -1;
   }
 
-  std::cout << output << std::endl;
+  if (fs.truncate(path, new_size) < 0) {
+    std::cout << (fs.existsFile(path) ? "Can't truncate file" : "File doesn't exist") << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int mv(fspp::FileSystemClient& fs, const std::string& query) {
+  static const std::regex full_regex(R"(^\s*mv\s+(/|(/[-\d\w.]+)+)\s+(/|(/[-\d\w.]+)+)\s*$)");
+  std::cerr << "mv command: ";
+
+  std::smatch match;
+  if (!std::regex_match(query, match, full_regex)) {
+    std::cout << "Wrong from_path or to_path format" << std::endl;
+    return -1;
+  }
+
+  const std::string& from_path = match[1];
+  const std::string& to_path = match[3];
+  std::cerr << "(from_path=" << from_path << ") ";
+  std::cerr << "(to_path=" << to_path << ") ";
+
+  if (fs.rename(from_path, to_path) < 0) {
+    fspp::FileStat stat_buf;
+    std::cout << (fs.stat(from_path, &stat_buf) == 0 ? "Can't move to to_path"
+                                                      : "Requested file or directory doesn't exist")
+              << std::endl;
+    return -1;
+  }
 
   return 0;
 }
@@ -173,10 +231,6 @@ int store(fspp::FileSystemClient& fs, const std::string& query) {
   assert(from_basename_start != nullptr);
   std::string from_basename(from_basename_start);
 
-  if (fs.existsDir(to_path)) {
-    to_path += from_basename;
-  }
-
   int from_fd = open(from_path.c_str(), O_RDONLY);
   if (from_fd < 0) {
     std::cout << "Can't open from_file" << std::endl;
@@ -201,8 +255,11 @@ int store(fspp::FileSystemClient& fs, const std::string& query) {
   uint64_t from_file_len = stat_buf.st_size;
   void* from_file_content = mmap64(nullptr, from_file_len, PROT_READ, MAP_PRIVATE, from_fd, 0);
 
-  if (!fs.existsFile(to_path)) {
-    if (fs.createFile(to_path) < 0) {
+  // to_path is usually a file, so it's resolved again only when it's a directory
+  fspp::FileHandle to_file;
+  if (fs.open(to_path, &to_file, /*create=*/true) < 0) {
+    if (!fs.existsDir(to_path) ||
+        fs.open(to_path + (to_path.back() == '/' ? "" : "/") + from_basename, &to_file, /*create=*/true) < 0) {
       std::cout << "Can't create file in app filesystem" << std::endl;
 
       munmap(from_file_content, from_file_len);
@@ -211,7 +268,24 @@ int store(fspp::FileSystemClient& fs, const std::string& query) {
     }
   }
 
-  int bytes_written = fs.writeFileContent(to_path, 0, from_file_content, from_file_len);
+  if (to_file.reserve(from_file_len) < 0) {
+    std::cout << "Not enough space in app filesystem" << std::endl;
+
+    munmap(from_file_content, from_file_len);
+    close(from_fd);
+    return -1;
+  }
+
+  // previous content of the file may be longer
+  if (to_file.truncate(from_file_len) < 0) {
+    std::cout << "Can't truncate file in app filesystem" << std::endl;
+
+    munmap(from_file_content, from_file_len);
+    close(from_fd);
+    return -1;
+  }
+
+  int bytes_written = to_file.pwrite(from_file_content, from_file_len, 0);
   if (bytes_written == -1) {
     std::cout << "Can't write to app filesystem" << std::endl;
 
@@ -245,7 +319,8 @@ int load(fspp::FileSystemClient& fs, const std::string& query) {
   std::cerr << "(from_path=" << from_path << ") ";
   std::cerr << "(to_path=" << to_path << ") ";
 
-  if (!fs.existsFile(from_path)) {
+  fspp::FileHandle from_file;
+  if (fs.open(from_path, &from_file) < 0) {
     std::cout << "Requested file doesn't exist" << std::endl;
     return -1;
   }
@@ -294,24 +369,37 @@ int load(fspp::FileSystemClient& fs, const std::string& query) {
     }
   }
 
-  uint64_t from_file_len = fs.fileSize(from_path);
+  uint64_t from_file_len = from_file.size();
+  // to_file is zeroed and only data ranges are written, so holes of from_file stay holes
+  ftruncate(to_fd, 0);
   ftruncate(to_fd, from_file_len);
-  void* to_file_content = mmap64(nullptr, from_file_len, PROT_WRITE, MAP_SHARED, to_fd, 0);
 
-  int bytes_read = fs.readFileContent(from_path, 0, to_file_content, from_file_len);
-  if (bytes_read == -1) {
-    std::cout << "Can't write to app filesystem" << std::endl;
+  // data is written straight from the mapped ffile, without copying it to a buffer first
+  std::vector<iovec> ranges;
+  uint64_t data_start;
+  for (uint64_t offset = 0; from_file.seekData(offset, &data_start) == 0;) {
+    uint64_t data_end;
+    from_file.seekHole(data_start, &data_end);
 
-    munmap(to_file_content, from_file_len);
-    close(to_fd);
-    return -1;
-  }
+    uint64_t current_len = std::min(data_end - data_start, LOAD_CHUNK_SIZE);
+    ranges.clear();
+    int bytes_read = from_file.mapRange(data_start, current_len, &ranges);
+    if (bytes_read < 0 || pwritevall(to_fd, ranges.data(), ranges.size(), data_start) < 0) {
+      std::cout << "Can't write to_file" << std::endl;
 
-  if ((uint64_t)bytes_read != from_file_len) {
-    std::cerr << "possible file corruption" << std::endl;
+      close(to_fd);
+      return -1;
+    }
+
+    if ((uint64_t)bytes_read != current_len) {
+      std::cerr << "possible file corruption" << std::endl;
+    }
+
+    // written ranges are released, so blocks freed meanwhile don't wait for the whole file
+    from_file.unmapRanges();
+    offset = data_start + current_len;
   }
 
-  munmap(to_file_content, from_file_len);
   close(to_fd);
 
   return 0;
@@ -346,6 +434,8 @@ int main(int argc, char** argv) {
       "\trmfile <filepath>\n\t\tdelete file\n"
       "\tmkdir <dirpath>\n\t\tcreate directory\n"
       "\trmdir <dirpath>\n\t\tdelete directory\n"
+      "\ttruncate <filepath> <size>\n\t\tchange file size, freeing blocks after the new end\n"
+      "\tmv <from_path> <to_path>\n\t\tmove file or directory, a file at to_path is replaced\n"
       "\tstore <from_path> <to_path>\n\t\tstore from outer filesystem to app filesystem\n"
       "\tload <from_path> <to_path>\n\t\tload to outer filesystem from app filesystem";
 
@@ -357,6 +447,8 @@ int main(int argc, char** argv) {
   const std::regex mkdir_cmd_regex(R"(^\s*mkdir\s+)");
   const std::regex rmdir_cmd_regex(R"(^\s*rmdir\s+)");
   const std::regex lsdir_cmd_regex(R"(^\s*lsdir\s+)");
+  const std::regex truncate_cmd_regex(R"(^\s*truncate\s+)");
+  const std::regex mv_cmd_regex(R"(^\s*mv\s+)");
   const std::regex store_cmd_regex(R"(^\s*store\s+)");
   const std::regex load_cmd_regex(R"(^\s*load\s+)");
 
@@ -393,6 +485,14 @@ int main(int argc, char** argv) {
       int result = lsdir(fs, input);
       std::cerr << (result < 0 ? "fail" : "success") << std::endl;
 
+    } else if (std::regex_search(input, match, truncate_cmd_regex)) {
+      int result = truncate(fs, input);
+      std::cerr << (result < 0 ? "fail" : "success") << std::endl;
+
+    } else if (std::regex_search(input, match, mv_cmd_regex)) {
+      int result = mv(fs, input);
+      std::cerr << (result < 0 ? "fail" : "success") << std::endl;
+
     } else if (std::regex_search(input, match, store_cmd_regex)) {
       int result = store(fs, input);
       std::cerr << (result < 0 ? "fail" : "success") << std::endl;
@@ -1,16 +1,12 @@
 #include "cmds.h"
-#include "support.h"
 
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <regex>
 
-#include <unistd.h>
-
-#include <support/files.h>
-#include <support/network.h>
-
-#include <network_constants/constants.h>
-
 int mkfile(fspp::FileSystemClient& fs, const std::string& query, std::ostream& user_output) {
   static const std::regex full_regex(R"(^\s*mkfile\s+(/|((/[\w.]+)+))\s*$)");
   std::cerr << "mkfile command: ";
@@ -24,18 +20,16 @@ int mkfile(fspp::FileSystemClient& fs, const std::string& query, std::ostream& u
   const std::string& path = match[1];
   std::cerr << "(path=" << path << ") ";
 
-  if (fs.existsDir(path)) {
-    user_output << "Already exists directory with the same name" << std::endl;
-    return -1;
-  }
-
-  if (fs.existsFile(path)) {
-    user_output << "File already exists" << std::endl;
-    return -1;
-  }
-
-  if (fs.createFile(path) < 0) {
-    user_output << "Can't create file" << std::endl;
+  // path is resolved once more only to explain a failure
+  if (fs.createFile(path, /*fail_if_exists=*/true) < 0) {
+    fspp::FileStat stat_buf;
+    if (fs.stat(path, &stat_buf) < 0) {
+      user_output << "Can't create file" << std::endl;
+    } else if (stat_buf.is_dir) {
+      user_output << "Already exists directory with the same name" << std::endl;
+    } else {
+      user_output << "File already exists" << std::endl;
+    }
     return -1;
   }
 
@@ -57,18 +51,15 @@ int rmfile(fspp::FileSystemClient& fs, const std::string& query, std::ostream& u
   const std::string& path = match[1];
   std::cerr << "(path=" << path << ") ";
 
-  if (fs.existsDir(path)) {
-    user_output << "You can't remove directory with rmfile" << std::endl;
-    return -1;
-  }
-
-  if (!fs.existsFile(path)) {
-    user_output << "File doesn't exist" << std::endl;
-    return -1;
-  }
-
   if (fs.deleteFile(path) < 0) {
-    user_output << "Can't delete file" << std::endl;
+    fspp::FileStat stat_buf;
+    if (fs.stat(path, &stat_buf) < 0) {
+      user_output << "File doesn't exist" << std::endl;
+    } else if (stat_buf.is_dir) {
+      user_output << "You can't remove directory with rmfile" << std::endl;
+    } else {
+      user_output << "Can't delete file" << std::endl;
+    }
     return -1;
   }
 
@@ -89,18 +80,15 @@ int mkdir(fspp::FileSystemClient& fs, const std::string& query, std::ostream& us
   const std::string& path = match[1];
   std::cerr << "(path=" << path << ") ";
 
-  if (fs.existsDir(path)) {
-    user_output << "Directory already exists" << std::endl;
-    return -1;
-  }
-
-  if (fs.existsFile(path)) {
-    user_output << "Already exists file with the same name" << std::endl;
-    return -1;
-  }
-
   if (fs.createDir(path) < 0) {
-    user_output << "Can't create directory" << std::endl;
+    fspp::FileStat stat_buf;
+    if (fs.stat(path, &stat_buf) < 0) {
+      user_output << "Can't create directory" << std::endl;
+    } else if (stat_buf.is_dir) {
+      user_output << "Directory already exists" << std::endl;
+    } else {
+      user_output << "Already exists file with the same name" << std::endl;
+    }
     return -1;
   }
 
@@ -121,18 +109,17 @@ int rmdir(fspp::FileSystemClient& fs, const std::string& query, std::ostream& us
   const std::string& path = match[1];
   std::cerr << "(path=" << path << ") ";
 
-  if (!fs.existsDir(path)) {
-    user_output << "Directory doesn't exist" << std::endl;
-    return -1;
-  }
-
   if (path == "/") {
     user_output << "You can't remove root directory" << std::endl;
     return -1;
   }
 
   if (fs.deleteDir(path) < 0) {
-    user_output << "Can't delete directory" << std::endl;
+    if (!fs.existsDir(path)) {
+      user_output << "Directory doesn't exist" << std::endl;
+    } else {
+      user_output << "Can't delete directory" << std::endl;
+    }
     return -1;
   }
 
@@ -140,7 +127,7 @@ int rmdir(fspp::FileSystemClient& fs, const std::string& query, std::ostream& us
   return 0;
 }
 
-int lsdir(fspp::FileSystemClient& fs, const std::string& query, std::ostream& user_output) {
+int lsdir(const std::string& query, std::string* path_ptr, std::ostream& user_output) {
   static const std::regex full_regex(R"(^\s*lsdir\s+(/|(/[\w.]+)+)\s*$)");
   std::cerr << "lsdir command: ";
 
@@ -150,28 +137,49 @@ int lsdir(fspp::FileSystemClient& fs, const std::string& query, std::ostream& us
     return -1;
   }
 
+  *path_ptr = match[1];
+  std::cerr << "(path=" << *path_ptr << ") ";
+  return 0;
+}
+
+int truncate(fspp::FileSystemClient& fs, const std::string& query, std::ostream& user_output) {
+  static const std::regex full_regex(R"(^\s*truncate\s+(/|(/[\w.]+)+)\s+(\d+)\s*$)");
+  std::cerr << "truncate command: ";
+
+  std::smatch match;
+  if (!std::regex_match(query, match, full_regex)) {
+    user_output << "Wrong path or size format" << std::endl;
+    return -1;
+  }
+
   const std::string& path = match[1];
+  const std::string& size_str = match[3];
   std::cerr << "(path=" << path << ") ";
+  std::cerr << "(size=" << size_str << ") ";
 
-  if (!fs.existsDir(path)) {
-    user_output << "Directory doesn't exist" << std::endl;
+  errno = 0;
+  uint64_t new_size = strtoull(size_str.c_str(), nullptr, 10);
+  if (errno == ERANGE) {
+    user_output << "Size is too big" << std::endl;
     return -1;
   }
 
-  std::string output;
-  if (fs.listDir(path, output) < 0) {
-    user_output << "Can't list directory" << std::endl;
+  if (fs.truncate(path, new_size) < 0) {
+    if (!fs.existsFile(path)) {
+      user_output << "File doesn't exist" << std::endl;
+    } else {
+      user_output << "Can't truncate file" << std::endl;
+    }
     return -1;
   }
 
-  user_output << path << ": " << output << std::endl;
-
+  user_output << "Ok" << std::endl;
   return 0;
 }
 
-int store(int socket_fd, fspp::FileSystemClient& fs, const std::string& query, std::ostream& user_output) {
-  static const std::regex full_regex(R"(^\s*store\s+(/|(/[-\d\w.]+)+)\s+(/|(/[-\d\w.]+)+)\s*$)");
-  std::cerr << "store command: ";
+int mv(fspp::FileSystemClient& fs, const std::string& query, std::ostream& user_output) {
+  static const std::regex full_regex(R"(^\s*mv\s+(/|(/[-\d\w.]+)+)\s+(/|(/[-\d\w.]+)+)\s*$)");
+  std::cerr << "mv command: ";
 
   std::smatch match;
   if (!std::regex_match(query, match, full_regex)) {
@@ -180,60 +188,64 @@ int store(int socket_fd, fspp::FileSystemClient& fs, const std::string& query, s
   }
 
   const std::string& from_path = match[1];
-  std::string to_path = match[3];
+  const std::string& to_path = match[3];
   std::cerr << "(from_path=" << from_path << ") ";
   std::cerr << "(to_path=" << to_path << ") ";
 
-  const char* from_basename_start = strrchr(from_path.c_str(), '/') + 1;
-  assert(from_basename_start != nullptr);
-  std::string from_basename(from_basename_start);
-
-  if (fs.existsDir(to_path)) {
-    to_path += from_basename;
-  }
-
-  if (!fs.existsFile(to_path)) {
-    if (fs.createFile(to_path) < 0) {
-      user_output << "Can't create file in app filesystem" << std::endl;
-      return -1;
+  if (fs.rename(from_path, to_path) < 0) {
+    fspp::FileStat stat_buf;
+    if (fs.stat(from_path, &stat_buf) < 0) {
+      user_output << "Requested file or directory doesn't exist" << std::endl;
+    } else {
+      user_output << "Can't move to to_path" << std::endl;
     }
+    return -1;
   }
 
-  writeall(socket_fd, sok, strlen(sok));
+  user_output << "Ok" << std::endl;
+  return 0;
+}
 
-  uint64_t file_len;
-  int bytes_read;
+int store(fspp::FileSystemClient& fs, const std::string& query, fspp::FileHandle* to_file_ptr, std::string* to_path_ptr,
+          bool* created_ptr, std::ostream& user_output) {
+  static const std::regex full_regex(R"(^\s*store\s+(/|(/[-\d\w.]+)+)\s+(/|(/[-\d\w.]+)+)\s*$)");
+  std::cerr << "store command: ";
 
-  if ((bytes_read = readall(socket_fd, &file_len, sizeof(file_len))) < 0 || bytes_read != sizeof(file_len)) {
-    user_output << "Can't receive file len" << std::endl;
+  std::smatch match;
+  if (!std::regex_match(query, match, full_regex)) {
+    user_output << "Wrong from_path or to_path format" << std::endl;
     return -1;
   }
 
-  file_len = ntoh64(file_len);
-  LOG_INFO("(file_len=" + std::to_string(file_len) + ")");
+  const std::string& from_path = match[1];
+  std::string to_path = match[3];
+  std::cerr << "(from_path=" << from_path << ") ";
+  std::cerr << "(to_path=" << to_path << ") ";
+
+  const char* from_basename_start = strrchr(from_path.c_str(), '/') + 1;
+  assert(from_basename_start != nullptr);
+  std::string from_basename(from_basename_start);
 
-  for (uint64_t bytes_written = 0; bytes_written < file_len;) {
-    char buffer[MAX_TRANSMISSION_LEN];
-    if ((bytes_read = read(socket_fd, buffer, sizeof(buffer))) < 0) {
-      // maybe add more smart way to have unfilled files
-      fs.deleteFile(to_path);
-      user_output << "Can't receive file content" << std::endl;
+  // to_path is usually a file, so it's resolved again only when it's a directory
+  if (fs.open(to_path, to_file_ptr, /*create=*/true, created_ptr) < 0) {
+    if (!fs.existsDir(to_path)) {
+      user_output << "Can't create file in app filesystem" << std::endl;
       return -1;
     }
 
-    uint64_t current_write_len = std::min((uint64_t)bytes_read, file_len - bytes_written);
-    if (fs.writeFileContent(to_path, bytes_written, buffer, current_write_len) < 0) {
-      user_output << "Writing to file failed" << std::endl;
+    to_path += (to_path.back() == '/' ? "" : "/") + from_basename;
+    if (fs.open(to_path, to_file_ptr, /*create=*/true, created_ptr) < 0) {
+      user_output << "Can't create file in app filesystem" << std::endl;
       return -1;
     }
-    bytes_written += current_write_len;
   }
 
-  user_output << "Ok" << std::endl;
+  *to_path_ptr = to_path;
   return 0;
 }
 
-int load(int socket_fd, fspp::FileSystemClient& fs, const std::string& query, std::ostream& user_output) {
+int load(fspp::FileSystemClient& fs, const std::string& query, fspp::FileHandle* from_file_ptr,
+         std::ostream& user_output) {
   static const std::regex full_regex(R"(^\s*load\s+(/|(/[\w.]+)+)\s+(/|(/[\w.]+)+)\s*$)");
   std::cerr << "load command: ";
 
@@ -248,44 +260,10 @@ int load(int socket_fd, fspp::FileSystemClient& fs, const std::string& query, st
   std::cerr << "(from_path=" << from_path << ") ";
   std::cerr << "(to_path=" << to_path << ") ";
 
-  if (!fs.existsFile(from_path)) {
+  if (fs.open(from_path, from_file_ptr) < 0) {
     user_output << "Requested file doesn't exist" << std::endl;
     return -1;
   }
 
-  if (writeall(socket_fd, sok, strlen(sok)) < 0) {
-    user_output << "Connection problems occurred" << std::endl;
-    return -1;
-  }
-
-  char cok_buffer[MAX_TRANSMISSION_LEN];
-  if (read(socket_fd, cok_buffer, sizeof(cok_buffer)) < 0) {
-    return -1;
-  }
-
-  uint64_t file_len = fs.fileSize(from_path);
-  LOG_INFO("(file_len=" + std::to_string(file_len) + ")");
-
-  uint64_t sending_from_file_len = hton64(file_len);
-  if (writeall(socket_fd, &sending_from_file_len, sizeof(sending_from_file_len)) < 0) {
-    user_output << "Can't send file len" << std::endl;
-    return -1;
-  }
-
-  for (uint64_t bytes_sent = 0; bytes_sent < file_len;) {
-    char buffer[4096];
-    uint64_t current_read_len = std::min((uint64_t)sizeof(buffer), file_len - bytes_sent);
-    if (fs.readFileContent(from_path, bytes_sent, buffer, current_read_len) < 0) {
-      user_output << "Reading of file failed" << std::endl;
-      return -1;
-    }
-
-    if (writeall(socket_fd, buffer, current_read_len) < 0) {
-      user_output << "Can't send file content" << std::endl;
-    }
-    bytes_sent += current_read_len;
-  }
-
-  user_output << "Ok" << std::endl;
   return 0;
-}
\ No newline at end of file
+}
@@ -8,6 +8,21 @@ int mkfile(fspp::FileSystemClient& fs, const std::string& query, std::ostream& u
 int rmfile(fspp::FileSystemClient& fs, const std::string& query, std::ostream& user_output);
 int mkdir(fspp::FileSystemClient& fs, const std::string& query, std::ostream& user_output);
 int rmdir(fspp::FileSystemClient& fs, const std::string& query, std::ostream& user_output);
-int lsdir(fspp::FileSystemClient& fs, const std::string& query, std::ostream& user_output);
-int store(int socket_fd, fspp::FileSystemClient& fs, const std::string& query, std::ostream& user_output);
-int load(int socket_fd, fspp::FileSystemClient& fs, const std::string& query, std::ostream& user_output);
+/*!
+ * only parses the query, listing is sent page by page by Connection
+ */
+int lsdir(const std::string& query, std::string* path_ptr, std::ostream& user_output);
+int truncate(fspp::FileSystemClient& fs, const std::string& query, std::ostream& user_output);
+int mv(fspp::FileSystemClient& fs, const std::string& query, std::ostream& user_output);
+/*!
+ * parses the query and opens the file, its content is received by Connection
+ * @param to_path_ptr where to store path of the opened file (to_path itself or to_path/from_basename)
+ * @param created_ptr where to store whether the file was created by the query
+ */
+int store(fspp::FileSystemClient& fs, const std::string& query, fspp::FileHandle* to_file_ptr, std::string* to_path_ptr,
+          bool* created_ptr, std::ostream& user_output);
+/*!
+ * parses the query and opens the file, its content is sent by Connection
+ */
+int load(fspp::FileSystemClient& fs, const std::string& query, fspp::FileHandle* from_file_ptr,
+         std::ostream& user_output);
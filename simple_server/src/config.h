@@ -3,4 +3,19 @@
 #include <cstdint>
 
 const uint64_t MAX_EPOLL_EVENTS = 10;
-const uint64_t PORT = 8800;
\ No newline at end of file
+const uint64_t PORT = 8800;
+// lsdir sends directory entries in pages of this size
+const uint64_t LSDIR_PAGE_SIZE = 256;
+// load sends file content straight from the mapped ffile in chunks of this size
+const uint64_t LOAD_CHUNK_SIZE = 64 * 1024 * 1024;
+// store receives file content in pieces of this size, the buffer is allocated only while content is received
+const uint64_t RECEIVE_BUFFER_SIZE = 256 * 1024;
+// connection yields to others after transferring this many bytes, so a big transfer doesn't delay short commands
+const uint64_t CONNECTION_STEP_SIZE = 4 * 1024 * 1024;
+// io_uring workers: submission queue size, receive buffers registered with every ring, how many of them one connection
+// may hold, and how many sends of one connection may be linked into a single submission
+const unsigned URING_ENTRY_COUNT = 256;
+const unsigned URING_BUFFER_COUNT = 128;
+const unsigned URING_BUFFER_SIZE = 32 * 1024;
+const unsigned URING_CONNECTION_BUFFER_COUNT = 4;
+const unsigned URING_MAX_LINKED_SENDS = 8;
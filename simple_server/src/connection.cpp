@@ -0,0 +1,365 @@
+#include "connection.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <string_view>
+
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <support/files.h>
+#include <support/network.h>
+
+#include <network_constants/constants.h>
+
+#include "cmds.h"
+#include "config.h"
+#include "processing.h"
+#include "support.h"
+
+Connection::Connection(fspp::FileSystemClient* fs, int socket_fd, Stream* stream)
+    : fs_(fs), socket_fd_(socket_fd), stream_(stream) {
+}
+
+Connection::~Connection() {
+  if (state_ == State::STORE_READING_CONTENT || (state_ == State::STORE_READING_LEN && is_file_created_)) {
+    abortStore();
+  }
+
+  shutdown(socket_fd_, SHUT_RDWR);
+  close(socket_fd_);
+}
+
+Connection::Status Connection::process() {
+  uint64_t bytes_moved = 0;
+  while (bytes_moved < CONNECTION_STEP_SIZE) {
+    // buffered output is sent before the next step, so the client sees responses in order
+    StepResult result = (output_offset_ < output_.size()) ? sendOutput(&bytes_moved) : step(&bytes_moved);
+    if (result == StepResult::BLOCKED) {
+      return Status::WAITING;
+    }
+
+    if (result == StepResult::CLOSE) {
+      return Status::CLOSED;
+    }
+  }
+
+  return Status::PENDING;
+}
+
+Connection::StepResult Connection::step(uint64_t* bytes_moved_ptr) {
+  switch (state_) {
+    case State::READING_QUERY: {
+      if (input_.empty()) {
+        StepResult result = receiveInput(MAX_QUERY_LEN, bytes_moved_ptr);
+        if (result != StepResult::PROGRESS || input_.empty()) {
+          return result;
+        }
+      }
+
+      std::string query = std::move(input_);
+      input_.clear();
+      return handleQuery(query);
+    }
+
+    case State::LISTING_DIR:
+      return listDir();
+
+    case State::STORE_READING_LEN:
+      if (input_.size() < sizeof(uint64_t)) {
+        return receiveInput(sizeof(uint64_t) - input_.size(), bytes_moved_ptr);
+      }
+      return readStoreLen();
+
+    case State::STORE_READING_CONTENT:
+    case State::STORE_SKIPPING_CONTENT:
+      return receiveContent(bytes_moved_ptr);
+
+    case State::LOAD_WAITING_COK: {
+      // confirmation is a whole read as well, unless it came in pieces
+      if (input_.size() < strlen(cok) && std::string_view(cok).starts_with(input_)) {
+        return receiveInput(MAX_TRANSMISSION_LEN, bytes_moved_ptr);
+      }
+
+      bool is_confirmed = (input_ == cok);
+      input_.clear();
+      if (!is_confirmed) {
+        file_.close();
+        std::cerr << "fail" << std::endl;
+        respond("Load wasn't confirmed by client\n");
+        return StepResult::PROGRESS;
+      }
+
+      file_len_ = file_.size();
+      transferred_len_ = 0;
+      LOG_INFO("(file_len=" + std::to_string(file_len_) + ")");
+
+      uint64_t sending_file_len = hton64(file_len_);
+      output_.append(reinterpret_cast<const char*>(&sending_file_len), sizeof(sending_file_len));
+      state_ = State::LOAD_SENDING_CONTENT;
+      return StepResult::PROGRESS;
+    }
+
+    case State::LOAD_SENDING_CONTENT:
+      return sendContent(bytes_moved_ptr);
+  }
+
+  return StepResult::CLOSE;
+}
+
+Connection::StepResult Connection::sendOutput(uint64_t* bytes_moved_ptr) {
+  ssize_t bytes_sent = stream_->send(output_.data() + output_offset_, output_.size() - output_offset_);
+  if (bytes_sent < 0) {
+    return resultOfFailedCall();
+  }
+
+  output_offset_ += bytes_sent;
+  *bytes_moved_ptr += bytes_sent;
+  if (output_offset_ == output_.size()) {
+    output_.clear();
+    output_offset_ = 0;
+  }
+
+  return StepResult::PROGRESS;
+}
+
+Connection::StepResult Connection::receiveInput(uint64_t max_count, uint64_t* bytes_moved_ptr) {
+  const char* data;
+  ssize_t bytes_read = stream_->peek(max_count, &data);
+  if (bytes_read < 0) {
+    return resultOfFailedCall();
+  }
+
+  // client closed the connection
+  if (bytes_read == 0) {
+    return StepResult::CLOSE;
+  }
+
+  input_.append(data, bytes_read);
+  stream_->consume(bytes_read);
+  *bytes_moved_ptr += bytes_read;
+  return StepResult::PROGRESS;
+}
+
+Connection::StepResult Connection::handleQuery(const std::string& query) {
+  static const std::regex exit_regex(R"(^\s*exit\s*$)");
+  static const std::regex store_cmd_regex(R"(^\s*store\s+)");
+  static const std::regex load_cmd_regex(R"(^\s*load\s+)");
+  static const std::regex lsdir_cmd_regex(R"(^\s*lsdir\s+)");
+
+  std::ostringstream user_output;
+
+  std::smatch match;
+  if (std::regex_match(query, match, exit_regex)) {
+    std::cerr << "exit command: exiting" << std::endl;
+    return StepResult::CLOSE;
+
+  } else if (std::regex_search(query, match, store_cmd_regex)) {
+    if (store(*fs_, query, &file_, &file_path_, &is_file_created_, user_output) >= 0) {
+      output_ += sok;
+      state_ = State::STORE_READING_LEN;
+      return StepResult::PROGRESS;
+    }
+    std::cerr << "fail" << std::endl;
+
+  } else if (std::regex_search(query, match, load_cmd_regex)) {
+    if (load(*fs_, query, &file_, user_output) >= 0) {
+      output_ += sok;
+      state_ = State::LOAD_WAITING_COK;
+      return StepResult::PROGRESS;
+    }
+    std::cerr << "fail" << std::endl;
+
+  } else if (std::regex_search(query, match, lsdir_cmd_regex)) {
+    if (lsdir(query, &dir_path_, user_output) >= 0) {
+      dir_cursor_ = 0;
+      state_ = State::LISTING_DIR;
+      return StepResult::PROGRESS;
+    }
+    std::cerr << "fail" << std::endl;
+
+  } else {
+    // process other commands
+    process_input(*fs_, query, user_output);
+  }
+
+  respond(user_output.str());
+  return StepResult::PROGRESS;
+}
+
+Connection::StepResult Connection::listDir() {
+  bool is_first_page = (dir_cursor_ == 0);
+
+  std::vector<fspp::DirEntry> entries;
+  if (fs_->readDir(dir_path_, &dir_cursor_, LSDIR_PAGE_SIZE, &entries) < 0) {
+    std::cerr << "fail" << std::endl;
+    // nothing is sent before the first page, it fails only if there is no such directory
+    respond(is_first_page ? "Directory doesn't exist\n" : "\n");
+    return StepResult::PROGRESS;
+  }
+
+  if (is_first_page) {
+    output_ += dir_path_ + ": ";
+  }
+
+  for (const auto& entry : entries) {
+    output_ += entry.name + (entry.is_dir ? "/ " : " ");
+  }
+
+  // the listing ends with a newline and the terminator like any other response
+  if (dir_cursor_ == fspp::DIR_END_CURSOR) {
+    std::cerr << "success" << std::endl;
+    respond("\n");
+  }
+
+  return StepResult::PROGRESS;
+}
+
+Connection::StepResult Connection::readStoreLen() {
+  uint64_t file_len;
+  memcpy(&file_len, input_.data(), sizeof(file_len));
+  input_.erase(0, sizeof(file_len));
+
+  file_len_ = ntoh64(file_len);
+  transferred_len_ = 0;
+  LOG_INFO("(file_len=" + std::to_string(file_len_) + ")");
+
+  if (file_.reserve(file_len_) < 0) {
+    skipContent("Not enough space in app filesystem\n");
+    return StepResult::PROGRESS;
+  }
+
+  // previous content of the file may be longer
+  if (file_.truncate(file_len_) < 0) {
+    skipContent("Can't truncate file in app filesystem\n");
+    return StepResult::PROGRESS;
+  }
+
+  state_ = State::STORE_READING_CONTENT;
+  return StepResult::PROGRESS;
+}
+
+Connection::StepResult Connection::receiveContent(uint64_t* bytes_moved_ptr) {
+  if (transferred_len_ == file_len_) {
+    stream_->trim();
+    if (state_ == State::STORE_SKIPPING_CONTENT) {
+      std::cerr << "fail" << std::endl;
+      respond(pending_error_);
+    } else {
+      file_.close();
+      std::cerr << "success" << std::endl;
+      respond("Ok\n");
+    }
+    return StepResult::PROGRESS;
+  }
+
+  uint64_t count = std::min(RECEIVE_BUFFER_SIZE, file_len_ - transferred_len_);
+  const char* data;
+  if (!input_.empty()) {
+    count = std::min<uint64_t>(count, input_.size());
+    data = input_.data();
+  } else {
+    // content is written to the file right from the stream buffer
+    ssize_t bytes_read = stream_->peek(count, &data);
+    if (bytes_read < 0) {
+      return resultOfFailedCall();
+    }
+
+    if (bytes_read == 0) {
+      return StepResult::CLOSE;
+    }
+
+    count = bytes_read;
+  }
+
+  if (state_ == State::STORE_READING_CONTENT && file_.pwrite(data, count, transferred_len_) < 0) {
+    skipContent("Writing to file failed\n");
+  }
+
+  if (!input_.empty()) {
+    input_.erase(0, count);
+  } else {
+    stream_->consume(count);
+  }
+  transferred_len_ += count;
+  *bytes_moved_ptr += count;
+  return StepResult::PROGRESS;
+}
+
+Connection::StepResult Connection::sendContent(uint64_t* bytes_moved_ptr) {
+  if (unsent_range_count_ == 0) {
+    if (transferred_len_ == file_len_) {
+      // mapped content may still be in flight, the handle keeps its blocks from reuse until it's sent
+      if (!stream_->isDrained()) {
+        return StepResult::BLOCKED;
+      }
+
+      file_.close();
+      std::cerr << "success" << std::endl;
+      respond("Ok\n");
+      return StepResult::PROGRESS;
+    }
+
+    // sent chunks are released once the stream doesn't refer to them, otherwise a truncate meanwhile keeps their
+    // blocks until the whole file is sent
+    if (stream_->isDrained()) {
+      file_.unmapRanges();
+    }
+
+    ranges_.clear();
+    int chunk_len = file_.mapRange(transferred_len_, std::min(LOAD_CHUNK_SIZE, file_len_ - transferred_len_), &ranges_);
+    if (chunk_len <= 0) {
+      // client waits for the rest of the content, so the connection can't be used anymore
+      LOG_ERROR("reading of file failed");
+      return StepResult::CLOSE;
+    }
+
+    unsent_ranges_ = ranges_.data();
+    unsent_range_count_ = ranges_.size();
+  }
+
+  ssize_t bytes_sent = stream_->sendv(unsent_ranges_, unsent_range_count_);
+  if (bytes_sent < 0) {
+    return resultOfFailedCall();
+  }
+
+  skip_written(&unsent_ranges_, &unsent_range_count_, bytes_sent);
+  transferred_len_ += bytes_sent;
+  *bytes_moved_ptr += bytes_sent;
+  return StepResult::PROGRESS;
+}
+
+Connection::StepResult Connection::resultOfFailedCall() {
+  if (errno == EAGAIN || errno == EWOULDBLOCK) {
+    return StepResult::BLOCKED;
+  }
+
+  // interrupted call is just repeated
+  return (errno == EINTR) ? StepResult::PROGRESS : StepResult::CLOSE;
+}
+
+void Connection::respond(const std::string& response) {
+  output_ += response;
+  output_ += RESPONSE_END;
+  state_ = State::READING_QUERY;
+}
+
+void Connection::skipContent(const std::string& error) {
+  if (is_file_created_) {
+    abortStore();
+  } else {
+    file_.close();
+  }
+  pending_error_ = error;
+  state_ = State::STORE_SKIPPING_CONTENT;
+}
+
+void Connection::abortStore() {
+  // partially received file isn't left in app filesystem
+  file_.close();
+  fs_->deleteFile(file_path_);
+}
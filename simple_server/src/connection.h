@@ -0,0 +1,119 @@
+#pragma once
+
+#include <sys/uio.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <fs++/filesystem_client.h>
+
+#include "stream.h"
+
+/*!
+ * Client connection over a non-blocking stream.
+ *
+ * Connection is a state machine driven by stream readiness: responses are buffered and sent while the stream accepts
+ * them, store and load transfer file content in steps and resume where they stopped. The exchange with the client is
+ * the same as with blocking processing, every read of a query is a whole query.
+ */
+class Connection {
+ public:
+  enum class Status {
+    // stream would block, process should be called on the next event
+    WAITING,
+    // step budget is spent, process should be called again without waiting for an event
+    PENDING,
+    // client exited or connection failed, connection should be destroyed
+    CLOSED,
+  };
+
+  /*!
+   * @param stream stream over _socket_fd_, it should outlive the connection
+   */
+  Connection(fspp::FileSystemClient* fs, int socket_fd, Stream* stream);
+  /*!
+   * closes the socket, file that was being stored is deleted (or only a new one, if its content wasn't received yet)
+   */
+  ~Connection();
+
+  Connection(const Connection& other) = delete;
+  Connection& operator=(const Connection& other) = delete;
+
+  /*!
+   * reads and writes until the stream would block or CONNECTION_STEP_SIZE bytes are transferred
+   */
+  Status process();
+
+ private:
+  enum class State {
+    READING_QUERY,
+    // lsdir pages are read as previous ones are sent
+    LISTING_DIR,
+    STORE_READING_LEN,
+    STORE_READING_CONTENT,
+    // content is read and dropped when it can't be stored, so the connection stays usable
+    STORE_SKIPPING_CONTENT,
+    LOAD_WAITING_COK,
+    LOAD_SENDING_CONTENT,
+  };
+
+  enum class StepResult {
+    PROGRESS,
+    BLOCKED,
+    CLOSE,
+  };
+
+  StepResult step(uint64_t* bytes_moved_ptr);
+  StepResult sendOutput(uint64_t* bytes_moved_ptr);
+
+  /*!
+   * appends up to _max_count_ bytes from the stream to _input_
+   */
+  StepResult receiveInput(uint64_t max_count, uint64_t* bytes_moved_ptr);
+
+  StepResult handleQuery(const std::string& query);
+  StepResult listDir();
+  StepResult readStoreLen();
+  StepResult receiveContent(uint64_t* bytes_moved_ptr);
+  StepResult sendContent(uint64_t* bytes_moved_ptr);
+
+  /*!
+   * @return what a stream call that failed with _errno_ means for the connection
+   */
+  static StepResult resultOfFailedCall();
+
+  void respond(const std::string& response);
+  /*!
+   * new file is deleted at once, content of an existing one is kept
+   */
+  void skipContent(const std::string& error);
+  void abortStore();
+
+ private:
+  fspp::FileSystemClient* fs_{nullptr};
+  int socket_fd_{-1};
+  Stream* stream_{nullptr};
+  State state_{State::READING_QUERY};
+
+  std::string input_;
+  std::string output_;
+  uint64_t output_offset_{0};
+
+  // state of lsdir
+  std::string dir_path_;
+  uint64_t dir_cursor_{0};
+
+  // state of store and load
+  fspp::FileHandle file_;
+  std::string file_path_;
+  // whether the stored file was created by this connection
+  bool is_file_created_{false};
+  uint64_t file_len_{0};
+  uint64_t transferred_len_{0};
+  std::string pending_error_;
+  // mapped chunk of the loaded file, it stays valid across yields until _file_ unmaps it, even if the file is truncated
+  std::vector<iovec> ranges_;
+  iovec* unsent_ranges_{nullptr};
+  size_t unsent_range_count_{0};
+};
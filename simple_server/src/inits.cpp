@@ -4,9 +4,10 @@
 #include <cstdio>
 #include <netinet/ip.h>
 #include <sys/epoll.h>
+#include <unistd.h>
 
 int init_socket(uint16_t port) {
-  int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+  int server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
 
   if (server_fd < 0) {
     LOG_ERROR_WITH_ERRNO_MSG("socket creation failed");
@@ -29,17 +30,26 @@ int init_socket(uint16_t port) {
   return server_fd;
 }
 
-int init_server_epoll(int listen_fd) {
+int init_server_epoll(int listen_fd, int stop_fd) {
   int epoll_fd = epoll_create1(0);
   if (epoll_fd < 0) {
     LOG_ERROR_WITH_ERRNO_MSG("epoll creation failed");
     return -1;
   }
 
-  struct epoll_event event = {.events = EPOLLIN};
+  // only one of the idle workers is woken up for a new connection
+  struct epoll_event event = {.events = EPOLLIN | EPOLLEXCLUSIVE};
   event.data.fd = listen_fd;
   if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) < 0) {
     LOG_ERROR_WITH_ERRNO_MSG("adding server fd to epoll queue failed");
+    close(epoll_fd);
+    return -1;
+  }
+
+  struct epoll_event stop_event = {.events = EPOLLIN, .data = {.fd = stop_fd}};
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stop_fd, &stop_event) < 0) {
+    LOG_ERROR_WITH_ERRNO_MSG("adding stop fd to epoll queue failed");
+    close(epoll_fd);
     return -1;
   }
 
@@ -2,5 +2,11 @@
 
 #include <cstdint>
 
+/*!
+ * listening socket is non-blocking, so workers that lose the race for a connection don't block in accept
+ */
 int init_socket(uint16_t port);
-int init_server_epoll(int listen_fd);
\ No newline at end of file
+/*!
+ * epoll instance of a worker: _listen_fd_ is added with EPOLLEXCLUSIVE, _stop_fd_ wakes up the worker to stop it
+ */
+int init_server_epoll(int listen_fd, int stop_fd);
\ No newline at end of file
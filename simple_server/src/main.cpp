@@ -1,38 +1,31 @@
+#include <algorithm>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <csignal>
+#include <cstdlib>
 
+#include <pthread.h>
 #include <unistd.h>
-#include <sys/epoll.h>
-#include <netinet/in.h>
+#include <sys/eventfd.h>
 
 #include <fs++/filesystem_client.h>
-#include <arpa/inet.h>
 
 #include "config.h"
 #include "inits.h"
-#include "processing.h"
 #include "support.h"
+#include "uring_worker.h"
+#include "worker.h"
 
-// signal handling
-volatile bool ending = false;
+// SIGINT and SIGTERM are blocked in all threads (workers inherit the mask) and are taken by the main thread
+int init_signal_handling(sigset_t* stop_signals_ptr) {
+  sigemptyset(stop_signals_ptr);
+  sigaddset(stop_signals_ptr, SIGINT);
+  sigaddset(stop_signals_ptr, SIGTERM);
 
-void signal_handler(int signum) {
-  (void)signum;
-  ending = true;
-}
-
-int init_signal_handling() {
-  struct sigaction action {};
-  action.sa_handler = signal_handler;
-  action.sa_flags = SA_RESTART;
-
-  if (sigaction(SIGTERM, &action, nullptr) < 0) {
-    return -1;
-  }
-
-  if (sigaction(SIGINT, &action, nullptr) < 0) {
+  if (pthread_sigmask(SIG_BLOCK, stop_signals_ptr, nullptr) != 0) {
     return -1;
   }
 
@@ -42,11 +35,30 @@ int init_signal_handling() {
 }
 
 int main(int argc, char** argv) {
-  if (argc != 2) {
-    std::cout << "Usage: " << argv[0] << " <ffile path>" << std::endl;
+  if (argc < 2 || argc > 4) {
+    std::cout << "Usage: " << argv[0] << " <ffile path> [worker count] [epoll|io_uring]" << std::endl;
     return EXIT_FAILURE;
   }
 
+  uint64_t worker_count = std::max(1u, std::thread::hardware_concurrency());
+  if (argc >= 3) {
+    worker_count = strtoull(argv[2], nullptr, 10);
+    if (worker_count == 0) {
+      std::cout << "Worker count should be a positive number" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  bool use_uring = false;
+  if (argc == 4) {
+    std::string backend(argv[3]);
+    if (backend != "epoll" && backend != "io_uring") {
+      std::cout << "I/O backend should be epoll or io_uring" << std::endl;
+      return EXIT_FAILURE;
+    }
+    use_uring = (backend == "io_uring");
+  }
+
   daemon(0, 0);
 
   // filesystem init
@@ -55,7 +67,8 @@ int main(int argc, char** argv) {
   LOG_INFO("filesystem initialized");
 
   // signal handling init
-  if (init_signal_handling() < 0) {
+  sigset_t stop_signals;
+  if (init_signal_handling(&stop_signals) < 0) {
     LOG_ERROR_WITH_ERRNO_MSG("signal handling init failed");
     return EXIT_FAILURE;
   }
@@ -69,57 +82,42 @@ int main(int argc, char** argv) {
   }
   LOG_INFO("socket initialized");
 
-  // epoll init
-
-  int epoll_fd = init_server_epoll(server_fd);
-  if (epoll_fd < 0) {
-    LOG_ERROR("epoll init failed");
+  // workers init
+  int stop_fd = eventfd(0, EFD_NONBLOCK);
+  if (stop_fd < 0) {
+    LOG_ERROR_WITH_ERRNO_MSG("eventfd creation failed");
+    return EXIT_FAILURE;
   }
-  LOG_INFO("epoll initialized");
-
-  // main loop
-  while (!ending) {
-    struct epoll_event events[MAX_EPOLL_EVENTS];
-
-    sigset_t mask;
-    sigfillset(&mask);
-    sigdelset(&mask, SIGINT);
-    sigdelset(&mask, SIGTERM);
-
-    int event_occurred;
-    if ((event_occurred = epoll_pwait(epoll_fd, events, MAX_EPOLL_EVENTS, -1, &mask)) < 0) {
-      if (errno == EINTR) {
-        continue;
-      }
-
-      LOG_ERROR_WITH_ERRNO_MSG("epoll_pwait failed");
-      return EXIT_FAILURE;
-    }
 
-    for (int i = 0; i < event_occurred && !ending; ++i) {
-      if (events[i].data.fd != server_fd) {
-        LOG_ERROR("Unexpected fd is in epoll queue");
-        return EXIT_FAILURE;
-      }
-
-      struct sockaddr_in address {};
-      socklen_t addrlen = sizeof(address);
+  if (use_uring && !is_uring_supported()) {
+    LOG_INFO("io_uring isn't supported, falling back to epoll");
+    use_uring = false;
+  }
 
-      int socket_fd = accept(server_fd, reinterpret_cast<sockaddr*>(&address), &addrlen);
-      if (socket_fd < 0) {
-        LOG_ERROR_WITH_ERRNO_MSG("connection accept failed");
-        continue;
+  auto run = use_uring ? run_uring_worker : run_worker;
+  std::vector<std::thread> workers;
+  for (uint64_t i = 0; i < worker_count; ++i) {
+    workers.emplace_back([&fs, run, server_fd, stop_fd] {
+      if (run(fs, server_fd, stop_fd) < 0) {
+        LOG_ERROR("worker failed");
       }
+    });
+  }
+  LOG_INFO(std::to_string(worker_count) + (use_uring ? " io_uring" : " epoll") + " workers started");
 
-      LOG_INFO("connection accepted (address=" + std::string(inet_ntoa(address.sin_addr)) + ")");
-
-      process_connection(fs, socket_fd);
+  int signum;
+  sigwait(&stop_signals, &signum);
+  LOG_INFO("stop signal received");
 
-      shutdown(socket_fd, SHUT_RDWR);
-      close(socket_fd);
-      LOG_INFO("connection finished");
-    }
+  // eventfd stays readable, so it wakes up all workers
+  eventfd_write(stop_fd, 1);
+  for (auto& worker : workers) {
+    worker.join();
   }
 
+  close(stop_fd);
+  close(server_fd);
+  LOG_INFO("server stopped");
+
   return EXIT_SUCCESS;
 }
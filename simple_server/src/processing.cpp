@@ -2,60 +2,9 @@
 
 #include <regex>
 
-#include <unistd.h>
-
-#include <support/files.h>
-
-#include <network_constants/constants.h>
-
 #include "cmds.h"
 #include "support.h"
 
-int process_connection(fspp::FileSystemClient& fs, int socket_fd) {
-  static const std::regex exit_regex(R"(^\s*exit\s*$)");
-  static const std::regex store_cmd_regex(R"(^\s*store\s+)");
-  static const std::regex load_cmd_regex(R"(^\s*load\s+)");
-
-  int bytes_read;
-  char buffer[MAX_QUERY_LEN];
-
-  // main connection loop
-  while (true) {
-    if ((bytes_read = read(socket_fd, &buffer, sizeof(buffer))) < 0) {
-      return -1;
-    }
-
-    std::string input(buffer, bytes_read);
-
-    std::ostringstream user_output;
-
-    std::smatch match;
-    if (std::regex_match(input, match, exit_regex)) {
-      std::cerr << "exit command: exiting" << std::endl;
-      return 0;
-
-    } else if (std::regex_search(input, match, store_cmd_regex)) {
-      int result = store(socket_fd, fs, input, user_output);
-      std::cerr << (result < 0 ? "fail" : "success") << std::endl;
-
-    } else if (std::regex_search(input, match, load_cmd_regex)) {
-      int result = load(socket_fd, fs, input, user_output);
-      std::cerr << (result < 0 ? "fail" : "success") << std::endl;
-    } else {
-      // process other commands
-      if (process_input(fs, input, user_output) < 0) {
-        return -1;
-      }
-    }
-
-    // writing output
-    std::string response = user_output.str();
-    if (writeall(socket_fd, response.c_str(), response.size()) < 0) {
-      return -1;
-    }
-  }
-}
-
 int process_input(fspp::FileSystemClient& fs, const std::string& input, std::ostream& user_output) {
   static const std::string help =
       "Commands:\n"
@@ -65,6 +14,8 @@ int process_input(fspp::FileSystemClient& fs, const std::string& input, std::ost
       "\trmfile <filepath>\n\t\tdelete file\n"
       "\tmkdir <dirpath>\n\t\tcreate directory\n"
       "\trmdir <dirpath>\n\t\tdelete directory\n"
+      "\ttruncate <filepath> <size>\n\t\tchange file size, freeing blocks after the new end\n"
+      "\tmv <from_path> <to_path>\n\t\tmove file or directory, a file at to_path is replaced\n"
       "\tstore <from_path> <to_path>\n\t\tstore from outer filesystem to app filesystem\n"
       "\tload <from_path> <to_path>\n\t\tload to outer filesystem from app filesystem";
 
@@ -75,7 +26,8 @@ int process_input(fspp::FileSystemClient& fs, const std::string& input, std::ost
   static const std::regex rmfile_cmd_regex(R"(^\s*rmfile\s+)");
   static const std::regex mkdir_cmd_regex(R"(^\s*mkdir\s+)");
   static const std::regex rmdir_cmd_regex(R"(^\s*rmdir\s+)");
-  static const std::regex lsdir_cmd_regex(R"(^\s*lsdir\s+)");
+  static const std::regex truncate_cmd_regex(R"(^\s*truncate\s+)");
+  static const std::regex mv_cmd_regex(R"(^\s*mv\s+)");
   static const std::regex store_cmd_regex(R"(^\s*store\s+)");
   static const std::regex load_cmd_regex(R"(^\s*load\s+)");
 
@@ -102,8 +54,12 @@ int process_input(fspp::FileSystemClient& fs, const std::string& input, std::ost
     int result = rmdir(fs, input, user_output);
     std::cerr << (result < 0 ? "fail" : "success") << std::endl;
 
-  } else if (std::regex_search(input, match, lsdir_cmd_regex)) {
-    int result = lsdir(fs, input, user_output);
+  } else if (std::regex_search(input, match, truncate_cmd_regex)) {
+    int result = truncate(fs, input, user_output);
+    std::cerr << (result < 0 ? "fail" : "success") << std::endl;
+
+  } else if (std::regex_search(input, match, mv_cmd_regex)) {
+    int result = mv(fs, input, user_output);
     std::cerr << (result < 0 ? "fail" : "success") << std::endl;
 
   } else if (std::regex_match(input, match, help_regex)) {
@@ -5,5 +5,8 @@
 
 #include <fs++/filesystem_client.h>
 
-int process_connection(fspp::FileSystemClient& fs, int socket_fd);
+/*!
+ * processes commands that don't transfer anything but the response
+ * @return -1 for exit command, 0 otherwise
+ */
 int process_input(fspp::FileSystemClient& fs, const std::string& input, std::ostream& user_output);
\ No newline at end of file
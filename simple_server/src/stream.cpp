@@ -0,0 +1,50 @@
+#include "stream.h"
+
+#include <algorithm>
+#include <climits>
+
+#include <sys/socket.h>
+
+#include "config.h"
+
+SocketStream::SocketStream(int socket_fd) : socket_fd_(socket_fd) {
+}
+
+ssize_t SocketStream::peek(size_t max_count, const char** data_ptr) {
+  if (begin_ == end_) {
+    begin_ = 0;
+    end_ = 0;
+
+    // buffer grows up to the largest read, so an idle connection keeps only a query-sized one
+    buffer_.resize(std::max(buffer_.size(), std::min<size_t>(max_count, RECEIVE_BUFFER_SIZE)));
+    ssize_t bytes_read = recv(socket_fd_, buffer_.data(), std::min(max_count, buffer_.size()), 0);
+    if (bytes_read <= 0) {
+      return bytes_read;
+    }
+
+    end_ = bytes_read;
+  }
+
+  *data_ptr = buffer_.data() + begin_;
+  return std::min(max_count, end_ - begin_);
+}
+
+void SocketStream::consume(size_t count) {
+  begin_ += count;
+}
+
+ssize_t SocketStream::send(const void* data, size_t count) {
+  return ::send(socket_fd_, data, count, 0);
+}
+
+ssize_t SocketStream::sendv(const iovec* ranges, size_t count) {
+  return writev(socket_fd_, ranges, (int)std::min(count, (size_t)IOV_MAX));
+}
+
+void SocketStream::trim() {
+  if (begin_ == end_) {
+    std::vector<char>().swap(buffer_);
+    begin_ = 0;
+    end_ = 0;
+  }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <vector>
+
+/*!
+ * Non-blocking byte stream of a connection, it hides how the I/O backend moves the bytes.
+ *
+ * Calls that would block fail with errno set to EAGAIN, the backend processes the connection again when they may
+ * succeed.
+ */
+class Stream {
+ public:
+  virtual ~Stream() = default;
+
+  /*!
+   * makes received bytes available without copying them
+   * @param data_ptr where to store pointer to the bytes, it's valid until consume
+   * @return number of available bytes (no more than _max_count_), 0 if the peer closed the connection,
+   * -1 on failure
+   */
+  virtual ssize_t peek(size_t max_count, const char** data_ptr) = 0;
+  virtual void consume(size_t count) = 0;
+
+  /*!
+   * @return number of accepted bytes, _data_ may be changed right after the call
+   */
+  virtual ssize_t send(const void* data, size_t count) = 0;
+
+  /*!
+   * @return number of accepted bytes, memory of the ranges should stay valid until isDrained
+   */
+  virtual ssize_t sendv(const iovec* ranges, size_t count) = 0;
+
+  /*!
+   * @return whether all accepted bytes left memory of the process
+   */
+  virtual bool isDrained() = 0;
+
+  /*!
+   * frees receive buffer after a transfer
+   */
+  virtual void trim() {
+  }
+};
+
+/*!
+ * Stream over a non-blocking socket, bytes are moved by plain syscalls when epoll reports readiness.
+ */
+class SocketStream : public Stream {
+ public:
+  explicit SocketStream(int socket_fd);
+
+  ssize_t peek(size_t max_count, const char** data_ptr) override;
+  void consume(size_t count) override;
+  ssize_t send(const void* data, size_t count) override;
+  ssize_t sendv(const iovec* ranges, size_t count) override;
+
+  bool isDrained() override {
+    return true;
+  }
+
+  void trim() override;
+
+ private:
+  int socket_fd_{-1};
+
+  // received bytes that aren't consumed yet are in [begin_, end_)
+  std::vector<char> buffer_;
+  size_t begin_{0};
+  size_t end_{0};
+};
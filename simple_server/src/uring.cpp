@@ -0,0 +1,210 @@
+#include "uring.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace {
+
+int io_uring_setup(unsigned entry_count, io_uring_params* params) {
+  return (int)syscall(__NR_io_uring_setup, entry_count, params);
+}
+
+int io_uring_enter(int ring_fd, unsigned to_submit, unsigned wait_count, unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, wait_count, flags, nullptr, 0);
+}
+
+int io_uring_register(int ring_fd, unsigned opcode, void* arg, unsigned arg_count) {
+  return (int)syscall(__NR_io_uring_register, ring_fd, opcode, arg, arg_count);
+}
+
+// ring indices are shared with the kernel
+unsigned load_acquire(unsigned* index) {
+  return std::atomic_ref<unsigned>(*index).load(std::memory_order_acquire);
+}
+
+void store_release(unsigned* index, unsigned value) {
+  std::atomic_ref<unsigned>(*index).store(value, std::memory_order_release);
+}
+
+}  // namespace
+
+Ring::~Ring() {
+  if (buffers_ != nullptr) {
+    munmap(buffers_, buffers_size_);
+  }
+  if (buffer_ring_ != nullptr) {
+    munmap(buffer_ring_, buffer_ring_size_);
+  }
+  if (sqes_ != nullptr) {
+    munmap(sqes_, sqes_size_);
+  }
+  if (rings_ != nullptr) {
+    munmap(rings_, rings_size_);
+  }
+  if (ring_fd_ >= 0) {
+    close(ring_fd_);
+  }
+}
+
+int Ring::init(unsigned entry_count) {
+  io_uring_params params{};
+  // completions are processed by the submitting thread only when it asks for them, which is the way workers use ring;
+  // kernels without these flags (before 6.1) also lack multishot receive, so they are rejected here
+  params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_SUBMIT_ALL |
+                 IORING_SETUP_CQSIZE;
+  // multishot requests post many completions for one submission
+  params.cq_entries = entry_count * 4;
+
+  ring_fd_ = io_uring_setup(entry_count, &params);
+  if (ring_fd_ < 0) {
+    return -1;
+  }
+
+  const uint32_t required_features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_SUBMIT_STABLE;
+  if ((params.features & required_features) != required_features) {
+    errno = ENOTSUP;
+    return -1;
+  }
+
+  rings_size_ = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                         params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+  void* rings = mmap(nullptr, rings_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                     IORING_OFF_SQ_RING);
+  if (rings == MAP_FAILED) {
+    return -1;
+  }
+  rings_ = rings;
+
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    return -1;
+  }
+  sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+  char* base = static_cast<char*>(rings_);
+  sq_head_ = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+  sq_mask_ = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+  sq_entry_count_ = params.sq_entries;
+  sqe_tail_ = *sq_tail_;
+
+  // entries are submitted in the order they are taken, so the index array is the identity
+  auto* sq_array = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+  for (unsigned i = 0; i < sq_entry_count_; ++i) {
+    sq_array[i] = i;
+  }
+
+  cq_head_ = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+
+  return 0;
+}
+
+int Ring::initBuffers(uint16_t group_id, unsigned count, unsigned size) {
+  buffer_ring_size_ = count * sizeof(io_uring_buf);
+  void* buffer_ring = mmap(nullptr, buffer_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffer_ring == MAP_FAILED) {
+    return -1;
+  }
+  buffer_ring_ = static_cast<io_uring_buf*>(buffer_ring);
+
+  buffers_size_ = (size_t)count * size;
+  void* buffers = mmap(nullptr, buffers_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffers == MAP_FAILED) {
+    return -1;
+  }
+  buffers_ = static_cast<char*>(buffers);
+  buffer_size_ = size;
+  buffer_mask_ = count - 1;
+
+  io_uring_buf_reg registration{};
+  registration.ring_addr = reinterpret_cast<uint64_t>(buffer_ring_);
+  registration.ring_entries = count;
+  registration.bgid = group_id;
+  if (io_uring_register(ring_fd_, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+    return -1;
+  }
+
+  for (unsigned i = 0; i < count; ++i) {
+    recycleBuffer(i);
+  }
+
+  return 0;
+}
+
+io_uring_sqe* Ring::getSqe() {
+  if (sqe_tail_ - load_acquire(sq_head_) == sq_entry_count_) {
+    if (submit(0) < 0 || sqe_tail_ - load_acquire(sq_head_) == sq_entry_count_) {
+      return nullptr;
+    }
+  }
+
+  io_uring_sqe* sqe = &sqes_[sqe_tail_ & sq_mask_];
+  ++sqe_tail_;
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+int Ring::reserveSqes(unsigned count) {
+  if (sq_entry_count_ - (sqe_tail_ - load_acquire(sq_head_)) >= count) {
+    return 0;
+  }
+
+  return submit(0);
+}
+
+int Ring::submitAndWait(unsigned wait_count) {
+  return submit(wait_count);
+}
+
+int Ring::submit(unsigned wait_count) {
+  store_release(sq_tail_, sqe_tail_);
+  unsigned to_submit = sqe_tail_ - load_acquire(sq_head_);
+
+  // completions are delivered only on enter with GETEVENTS, even when nothing is awaited
+  while (io_uring_enter(ring_fd_, to_submit, wait_count, IORING_ENTER_GETEVENTS) < 0) {
+    // EBUSY: completion queue overflowed, completions should be reaped before new submissions
+    if (errno == EBUSY && peekCqe() != nullptr) {
+      return 0;
+    }
+
+    if (errno != EINTR) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+io_uring_cqe* Ring::peekCqe() {
+  unsigned head = *cq_head_;
+  if (head == load_acquire(cq_tail_)) {
+    return nullptr;
+  }
+
+  return &cqes_[head & cq_mask_];
+}
+
+void Ring::popCqe() {
+  store_release(cq_head_, *cq_head_ + 1);
+}
+
+void Ring::recycleBuffer(uint16_t buffer_id) {
+  io_uring_buf* buf = &buffer_ring_[buffer_tail_ & buffer_mask_];
+  buf->addr = reinterpret_cast<uint64_t>(buffer(buffer_id));
+  buf->len = buffer_size_;
+  buf->bid = buffer_id;
+
+  ++buffer_tail_;
+  std::atomic_ref<uint16_t>(buffer_ring_[0].resv).store(buffer_tail_, std::memory_order_release);
+  ++free_buffer_count_;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <linux/io_uring.h>
+
+#include <cstddef>
+#include <cstdint>
+
+/*!
+ * io_uring instance over raw syscalls: submission and completion queues and a ring of provided receive buffers.
+ *
+ * Ring is used by the thread that created it only.
+ */
+class Ring {
+ public:
+  Ring() = default;
+  ~Ring();
+
+  Ring(const Ring& other) = delete;
+  Ring& operator=(const Ring& other) = delete;
+
+  /*!
+   * @return 0 on success, -1 if kernel doesn't support io_uring features the server relies on
+   */
+  int init(unsigned entry_count);
+
+  /*!
+   * registers _count_ buffers of _size_ bytes, received data is placed into them by the kernel
+   * @param count power of two
+   * @return 0 on success, -1 on failure
+   */
+  int initBuffers(uint16_t group_id, unsigned count, unsigned size);
+
+  /*!
+   * @return zeroed submission entry, nullptr if queue is full and can't be submitted
+   */
+  io_uring_sqe* getSqe();
+
+  /*!
+   * submits queued entries if fewer than _count_ entries are free, so the next _count_ ones are submitted together
+   * @return 0 on success, -1 on failure
+   */
+  int reserveSqes(unsigned count);
+
+  /*!
+   * submits queued entries and waits for at least _wait_count_ completions
+   * @return 0 on success, -1 on failure
+   */
+  int submitAndWait(unsigned wait_count);
+
+  /*!
+   * @return next completion, nullptr if there is none, it stays valid until popCqe
+   */
+  io_uring_cqe* peekCqe();
+  void popCqe();
+
+  char* buffer(uint16_t buffer_id) {
+    return buffers_ + (size_t)buffer_id * buffer_size_;
+  }
+
+  /*!
+   * returns buffer to the kernel after its data is consumed
+   */
+  void recycleBuffer(uint16_t buffer_id);
+
+  bool hasFreeBuffers() const {
+    return free_buffer_count_ > 0;
+  }
+
+  /*!
+   * accounts buffer that the kernel filled
+   */
+  void takeBuffer() {
+    --free_buffer_count_;
+  }
+
+ private:
+  int submit(unsigned wait_count);
+
+ private:
+  int ring_fd_{-1};
+
+  void* rings_{nullptr};
+  size_t rings_size_{0};
+  io_uring_sqe* sqes_{nullptr};
+  size_t sqes_size_{0};
+
+  unsigned* sq_head_{nullptr};
+  unsigned* sq_tail_{nullptr};
+  unsigned sq_mask_{0};
+  unsigned sq_entry_count_{0};
+  // tail of entries handed out by getSqe, it's published to the kernel on submit
+  unsigned sqe_tail_{0};
+
+  unsigned* cq_head_{nullptr};
+  unsigned* cq_tail_{nullptr};
+  unsigned cq_mask_{0};
+  io_uring_cqe* cqes_{nullptr};
+
+  // io_uring_buf_ring is declared with a C flexible array that has a different layout in C++, so the ring is accessed
+  // as an array of entries, the tail overlays resv of the first one
+  io_uring_buf* buffer_ring_{nullptr};
+  size_t buffer_ring_size_{0};
+  char* buffers_{nullptr};
+  size_t buffers_size_{0};
+  unsigned buffer_size_{0};
+  unsigned buffer_mask_{0};
+  uint16_t buffer_tail_{0};
+  unsigned free_buffer_count_{0};
+};
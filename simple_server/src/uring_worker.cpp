@@ -0,0 +1,480 @@
+#include "uring_worker.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "config.h"
+#include "connection.h"
+#include "stream.h"
+#include "support.h"
+#include "uring.h"
+
+namespace {
+
+const uint16_t BUFFER_GROUP_ID = 0;
+
+// kind of request, it's kept in the low byte of user data, the rest is id of the connection
+enum Operation : uint64_t {
+  ACCEPT,
+  STOP,
+  RECEIVE,
+  SEND,
+};
+
+uint64_t make_user_data(uint64_t connection_id, Operation operation) {
+  return (connection_id << 8) | operation;
+}
+
+/*!
+ * Stream over io_uring requests of a worker ring.
+ *
+ * Received data stays in the registered buffers until it's consumed, receive isn't resubmitted while the stream holds
+ * URING_CONNECTION_BUFFER_COUNT of them, so a fast client can't take buffers of the others. Sends are queued and
+ * submitted as one linked chain after the processing step, new ones are refused until the chain completes.
+ */
+class UringStream : public Stream {
+ public:
+  UringStream(Ring* ring, int socket_fd) : ring_(ring), socket_fd_(socket_fd) {
+  }
+
+  ~UringStream() override {
+    dropReceived();
+  }
+
+  ssize_t peek(size_t max_count, const char** data_ptr) override {
+    if (received_.empty()) {
+      if (error_ != 0) {
+        errno = error_;
+        return -1;
+      }
+
+      if (is_eof_) {
+        return 0;
+      }
+
+      errno = EAGAIN;
+      return -1;
+    }
+
+    const ReceivedBuffer& front = received_.front();
+    *data_ptr = ring_->buffer(front.id) + front.offset;
+    return std::min<size_t>(max_count, front.len - front.offset);
+  }
+
+  void consume(size_t count) override {
+    ReceivedBuffer& front = received_.front();
+    front.offset += count;
+    if (front.offset == front.len) {
+      ring_->recycleBuffer(front.id);
+      received_.pop_front();
+    }
+  }
+
+  ssize_t send(const void* data, size_t count) override {
+    if (!canQueueSend()) {
+      return -1;
+    }
+
+    // data is copied, the caller reuses its buffer
+    Send& send = queued_sends_.emplace_back();
+    send.data.assign(static_cast<const char*>(data), count);
+    send.len = count;
+    return (ssize_t)count;
+  }
+
+  ssize_t sendv(const iovec* ranges, size_t count) override {
+    if (!canQueueSend()) {
+      return -1;
+    }
+
+    Send& send = queued_sends_.emplace_back();
+    send.ranges.assign(ranges, ranges + std::min(count, (size_t)IOV_MAX));
+    for (const iovec& range : send.ranges) {
+      send.len += range.iov_len;
+    }
+    return (ssize_t)send.len;
+  }
+
+  bool isDrained() override {
+    return queued_sends_.empty() && in_flight_sends_.empty();
+  }
+
+  /*!
+   * shuts the socket down and drops received data and queued sends, so requests in flight complete soon
+   * @note the socket is closed by its connection
+   */
+  void close() {
+    if (is_closed_) {
+      return;
+    }
+
+    shutdown(socket_fd_, SHUT_RDWR);
+    dropReceived();
+    queued_sends_.clear();
+    is_closed_ = true;
+  }
+
+  /*!
+   * @return whether no request in flight refers to the stream, so it can be destroyed
+   */
+  bool isIdle() const {
+    return !is_receiving_ && in_flight_sends_.empty();
+  }
+
+  /*!
+   * @return whether receive should be resubmitted, every receive takes one buffer
+   */
+  bool wantsReceive() const {
+    return !is_closed_ && !is_receiving_ && !is_eof_ && error_ == 0 &&
+           received_.size() < URING_CONNECTION_BUFFER_COUNT;
+  }
+
+  int submitReceive(uint64_t user_data) {
+    io_uring_sqe* sqe = ring_->getSqe();
+    if (sqe == nullptr) {
+      return -1;
+    }
+
+    // multishot receive would stay armed and keep taking buffers however many of them the stream holds
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = socket_fd_;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP_ID;
+    sqe->user_data = user_data;
+    is_receiving_ = true;
+    return 0;
+  }
+
+  int submitSends(uint64_t user_data) {
+    if (queued_sends_.empty()) {
+      return 0;
+    }
+
+    // a chain split between two submissions isn't ordered
+    if (ring_->reserveSqes(queued_sends_.size()) < 0) {
+      return -1;
+    }
+
+    size_t chain_len = queued_sends_.size();
+    for (size_t i = 0; i < chain_len; ++i) {
+      Send& send = in_flight_sends_.emplace_back(std::move(queued_sends_[i]));
+      if (!send.data.empty()) {
+        send.ranges.assign(1, iovec{send.data.data(), send.data.size()});
+      }
+      send.message.msg_iov = send.ranges.data();
+      send.message.msg_iovlen = send.ranges.size();
+
+      io_uring_sqe* sqe = ring_->getSqe();
+      if (sqe == nullptr) {
+        return -1;
+      }
+
+      sqe->opcode = IORING_OP_SENDMSG;
+      sqe->fd = socket_fd_;
+      sqe->addr = reinterpret_cast<uint64_t>(&send.message);
+      // kernel retries short sends, so a send completes in full or fails and cancels the rest of the chain
+      sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+      sqe->flags = (i + 1 < chain_len) ? IOSQE_IO_LINK : 0;
+      sqe->user_data = user_data;
+    }
+    queued_sends_.clear();
+
+    return 0;
+  }
+
+  void onReceive(const io_uring_cqe& cqe) {
+    is_receiving_ = false;
+
+    if (cqe.flags & IORING_CQE_F_BUFFER) {
+      ring_->takeBuffer();
+      auto buffer_id = (uint16_t)(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+      if (is_closed_ || cqe.res <= 0) {
+        ring_->recycleBuffer(buffer_id);
+      } else {
+        received_.push_back({buffer_id, (uint32_t)cqe.res, 0});
+      }
+      return;
+    }
+
+    if (cqe.res == 0) {
+      is_eof_ = true;
+    } else if (cqe.res < 0 && cqe.res != -ENOBUFS && error_ == 0) {
+      error_ = -cqe.res;
+    }
+  }
+
+  void onSend(const io_uring_cqe& cqe) {
+    // completions of a chain come in order
+    if ((cqe.res < 0 || (uint64_t)cqe.res < in_flight_sends_.front().len) && error_ == 0) {
+      error_ = (cqe.res < 0) ? -cqe.res : EPIPE;
+    }
+    in_flight_sends_.pop_front();
+  }
+
+ private:
+  struct ReceivedBuffer {
+    uint16_t id;
+    uint32_t len;
+    uint32_t offset;
+  };
+
+  struct Send {
+    // copy of sent bytes, ranges refer to caller memory if it's empty
+    std::string data;
+    std::vector<iovec> ranges;
+    msghdr message{};
+    uint64_t len{0};
+  };
+
+  void dropReceived() {
+    for (const ReceivedBuffer& buffer : received_) {
+      ring_->recycleBuffer(buffer.id);
+    }
+    received_.clear();
+  }
+
+  bool canQueueSend() {
+    if (error_ != 0) {
+      errno = error_;
+      return false;
+    }
+
+    if (!in_flight_sends_.empty() || queued_sends_.size() == URING_MAX_LINKED_SENDS) {
+      errno = EAGAIN;
+      return false;
+    }
+
+    return true;
+  }
+
+ private:
+  Ring* ring_{nullptr};
+  int socket_fd_{-1};
+
+  std::deque<ReceivedBuffer> received_;
+  bool is_receiving_{false};
+  bool is_eof_{false};
+  bool is_closed_{false};
+  // errno of the first failed request, the connection is closed when it sees it
+  int error_{0};
+
+  std::deque<Send> queued_sends_;
+  std::deque<Send> in_flight_sends_;
+};
+
+struct ConnectionSlot {
+  std::unique_ptr<UringStream> stream;
+  // connection is destroyed before its stream, both live until requests of the stream complete: sends in flight may
+  // refer to file ranges mapped by the connection
+  std::unique_ptr<Connection> connection;
+  bool is_closed{false};
+  // whether the connection is in the queue of ready ones
+  bool is_ready{false};
+};
+
+int submit_accept(Ring* ring, int listen_fd) {
+  io_uring_sqe* sqe = ring->getSqe();
+  if (sqe == nullptr) {
+    return -1;
+  }
+
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = listen_fd;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_CLOEXEC;
+  sqe->user_data = make_user_data(0, ACCEPT);
+  return 0;
+}
+
+int submit_stop_poll(Ring* ring, int stop_fd) {
+  io_uring_sqe* sqe = ring->getSqe();
+  if (sqe == nullptr) {
+    return -1;
+  }
+
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = stop_fd;
+  sqe->poll32_events = POLLIN;
+  sqe->user_data = make_user_data(0, STOP);
+  return 0;
+}
+
+int init_ring(Ring* ring) {
+  if (ring->init(URING_ENTRY_COUNT) < 0) {
+    return -1;
+  }
+
+  return ring->initBuffers(BUFFER_GROUP_ID, URING_BUFFER_COUNT, URING_BUFFER_SIZE);
+}
+
+void log_accepted(int socket_fd) {
+  struct sockaddr_in address {};
+  socklen_t addrlen = sizeof(address);
+  getpeername(socket_fd, reinterpret_cast<sockaddr*>(&address), &addrlen);
+
+  char address_str[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &address.sin_addr, address_str, sizeof(address_str));
+  LOG_INFO("connection accepted (address=" + std::string(address_str) + ")");
+}
+
+}  // namespace
+
+bool is_uring_supported() {
+  Ring ring;
+  return init_ring(&ring) == 0;
+}
+
+int run_uring_worker(fspp::FileSystemClient& fs, int listen_fd, int stop_fd) {
+  Ring ring;
+  if (init_ring(&ring) < 0 || submit_accept(&ring, listen_fd) < 0 || submit_stop_poll(&ring, stop_fd) < 0) {
+    LOG_ERROR_WITH_ERRNO_MSG("io_uring init failed");
+    return -1;
+  }
+
+  std::unordered_map<uint64_t, ConnectionSlot> connections;
+  uint64_t next_connection_id = 1;
+  // connections that got completions or spent their step budget
+  std::deque<uint64_t> ready_ids;
+  // connections whose receive stopped because all buffers were taken
+  std::deque<uint64_t> starving_ids;
+  bool is_stopping = false;
+
+  auto make_ready = [&](uint64_t id) {
+    auto it = connections.find(id);
+    if (it != connections.end() && !it->second.is_ready) {
+      it->second.is_ready = true;
+      ready_ids.push_back(id);
+    }
+  };
+
+  auto close_connection = [&](ConnectionSlot* slot) {
+    slot->is_closed = true;
+    slot->stream->close();
+  };
+
+  // after a step, requests the connection needs are submitted, it's forgotten once nothing refers to its stream
+  auto finish_step = [&](uint64_t id, ConnectionSlot* slot) {
+    UringStream* stream = slot->stream.get();
+    if (stream->submitSends(make_user_data(id, SEND)) < 0) {
+      return -1;
+    }
+
+    if (stream->wantsReceive()) {
+      if (!ring.hasFreeBuffers()) {
+        starving_ids.push_back(id);
+      } else if (stream->submitReceive(make_user_data(id, RECEIVE)) < 0) {
+        return -1;
+      }
+    }
+
+    if (slot->is_closed && stream->isIdle()) {
+      connections.erase(id);
+    }
+    return 0;
+  };
+
+  while (!is_stopping || !connections.empty()) {
+    if (ring.submitAndWait(ready_ids.empty() ? 1 : 0) < 0) {
+      LOG_ERROR_WITH_ERRNO_MSG("io_uring_enter failed");
+      return -1;
+    }
+
+    for (io_uring_cqe* cqe; (cqe = ring.peekCqe()) != nullptr; ring.popCqe()) {
+      uint64_t id = cqe->user_data >> 8;
+      switch (cqe->user_data & 0xff) {
+        case STOP:
+          // transfers in progress are dropped with their connections
+          is_stopping = true;
+          for (auto& [connection_id, slot] : connections) {
+            close_connection(&slot);
+            make_ready(connection_id);
+          }
+          break;
+
+        case ACCEPT:
+          if (cqe->res >= 0 && is_stopping) {
+            close(cqe->res);
+          } else if (cqe->res >= 0) {
+            log_accepted(cqe->res);
+            uint64_t connection_id = next_connection_id++;
+            ConnectionSlot& slot = connections[connection_id];
+            slot.stream = std::make_unique<UringStream>(&ring, cqe->res);
+            slot.connection = std::make_unique<Connection>(&fs, cqe->res, slot.stream.get());
+            make_ready(connection_id);
+          } else if (cqe->res != -EAGAIN) {
+            errno = -cqe->res;
+            LOG_ERROR_WITH_ERRNO_MSG("connection accept failed");
+          }
+
+          // multishot accept may stop, for example when completion queue overflows
+          if (!(cqe->flags & IORING_CQE_F_MORE) && !is_stopping && submit_accept(&ring, listen_fd) < 0) {
+            LOG_ERROR_WITH_ERRNO_MSG("accept submission failed");
+            return -1;
+          }
+          break;
+
+        case RECEIVE:
+          connections.at(id).stream->onReceive(*cqe);
+          make_ready(id);
+          break;
+
+        case SEND:
+          connections.at(id).stream->onSend(*cqe);
+          make_ready(id);
+          break;
+      }
+    }
+
+    if (ring.hasFreeBuffers()) {
+      for (uint64_t id : starving_ids) {
+        make_ready(id);
+      }
+      starving_ids.clear();
+    }
+
+    // every ready connection does one step, new completions are checked in between
+    std::deque<uint64_t> processed_ids;
+    processed_ids.swap(ready_ids);
+    for (uint64_t id : processed_ids) {
+      auto it = connections.find(id);
+      if (it == connections.end()) {
+        continue;
+      }
+
+      ConnectionSlot& slot = it->second;
+      slot.is_ready = false;
+      if (!slot.is_closed) {
+        switch (slot.connection->process()) {
+          case Connection::Status::WAITING:
+            break;
+          case Connection::Status::PENDING:
+            make_ready(id);
+            break;
+          case Connection::Status::CLOSED:
+            close_connection(&slot);
+            LOG_INFO("connection finished");
+            break;
+        }
+      }
+
+      if (finish_step(id, &slot) < 0) {
+        LOG_ERROR_WITH_ERRNO_MSG("io_uring submission failed");
+        return -1;
+      }
+    }
+  }
+
+  return 0;
+}
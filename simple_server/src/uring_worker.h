@@ -0,0 +1,17 @@
+#pragma once
+
+#include <fs++/filesystem_client.h>
+
+/*!
+ * @return whether kernel supports io_uring features that run_uring_worker relies on
+ */
+bool is_uring_supported();
+
+/*!
+ * same as run_worker, but I/O of the worker goes through its own io_uring instance
+ *
+ * connections are accepted by a multishot accept on the shared listening socket and read by multishot receives into
+ * buffers registered with the ring, so a busy connection costs no syscall per read. Sends of one processing step are
+ * linked into a chain that is submitted at once, load content is sent right from the mapped ffile
+ */
+int run_uring_worker(fspp::FileSystemClient& fs, int listen_fd, int stop_fd);
@@ -0,0 +1,134 @@
+#include "worker.h"
+
+#include <deque>
+#include <memory>
+#include <unordered_map>
+
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+
+#include "config.h"
+#include "connection.h"
+#include "inits.h"
+#include "support.h"
+
+namespace {
+
+struct ConnectionSlot {
+  std::unique_ptr<SocketStream> stream;
+  std::unique_ptr<Connection> connection;
+  // whether the connection is in the queue of pending ones
+  bool is_pending{false};
+};
+
+}  // namespace
+
+int run_worker(fspp::FileSystemClient& fs, int listen_fd, int stop_fd) {
+  int epoll_fd = init_server_epoll(listen_fd, stop_fd);
+  if (epoll_fd < 0) {
+    LOG_ERROR("epoll init failed");
+    return -1;
+  }
+
+  std::unordered_map<int, ConnectionSlot> connections;
+  // connections that spent their step budget and have more to do, events won't come for them
+  std::deque<int> pending_fds;
+
+  auto process = [&](int socket_fd) {
+    auto it = connections.find(socket_fd);
+    if (it == connections.end()) {
+      return;
+    }
+
+    switch (it->second.connection->process()) {
+      case Connection::Status::WAITING:
+        break;
+      case Connection::Status::PENDING:
+        if (!it->second.is_pending) {
+          it->second.is_pending = true;
+          pending_fds.push_back(socket_fd);
+        }
+        break;
+      case Connection::Status::CLOSED:
+        connections.erase(it);
+        LOG_INFO("connection finished");
+        break;
+    }
+  };
+
+  while (true) {
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+
+    int event_occurred;
+    int timeout = pending_fds.empty() ? -1 : 0;
+    if ((event_occurred = epoll_wait(epoll_fd, events, MAX_EPOLL_EVENTS, timeout)) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      LOG_ERROR_WITH_ERRNO_MSG("epoll_wait failed");
+      close(epoll_fd);
+      return -1;
+    }
+
+    for (int i = 0; i < event_occurred; ++i) {
+      int fd = events[i].data.fd;
+      if (fd == stop_fd) {
+        // transfers in progress are dropped with their connections
+        close(epoll_fd);
+        return 0;
+      }
+
+      if (fd != listen_fd) {
+        process(fd);
+        continue;
+      }
+
+      // only one worker is woken up for the listen fd, so it accepts all queued connections at once
+      while (true) {
+        struct sockaddr_in address {};
+        socklen_t addrlen = sizeof(address);
+
+        int socket_fd = accept4(listen_fd, reinterpret_cast<sockaddr*>(&address), &addrlen, SOCK_NONBLOCK);
+        if (socket_fd < 0) {
+          if (errno == EINTR || errno == ECONNABORTED) {
+            continue;
+          }
+
+          // queue is empty, some of its connections may be taken by other workers
+          if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            LOG_ERROR_WITH_ERRNO_MSG("connection accept failed");
+          }
+          break;
+        }
+
+        char address_str[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &address.sin_addr, address_str, sizeof(address_str));
+        LOG_INFO("connection accepted (address=" + std::string(address_str) + ")");
+
+        // edge-triggered: connection reads and writes until the socket would block, so no event is lost
+        struct epoll_event event = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data = {.fd = socket_fd}};
+        ConnectionSlot& slot = connections[socket_fd];
+        slot.stream = std::make_unique<SocketStream>(socket_fd);
+        slot.connection = std::make_unique<Connection>(&fs, socket_fd, slot.stream.get());
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket_fd, &event) < 0) {
+          LOG_ERROR_WITH_ERRNO_MSG("adding connection fd to epoll queue failed");
+          connections.erase(socket_fd);
+        }
+      }
+    }
+
+    // every pending connection does one more step, new events are checked in between
+    std::deque<int> ready_fds;
+    ready_fds.swap(pending_fds);
+    for (int socket_fd : ready_fds) {
+      auto it = connections.find(socket_fd);
+      if (it != connections.end()) {
+        it->second.is_pending = false;
+        process(socket_fd);
+      }
+    }
+  }
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <fs++/filesystem_client.h>
+
+/*!
+ * accepts connections from _listen_fd_ and processes them until _stop_fd_ becomes readable
+ *
+ * every worker waits on its own epoll instance, the listening socket is shared by all of them with EPOLLEXCLUSIVE,
+ * so a connection is accepted by one of the workers that are waiting at the moment. Connections are non-blocking and
+ * take turns, so one worker serves any number of them
+ */
+int run_worker(fspp::FileSystemClient& fs, int listen_fd, int stop_fd);